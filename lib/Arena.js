@@ -0,0 +1,121 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const _ = require('lodash');
+const assert = require('assert');
+const native = require('./native');
+const verify = require('./verify');
+const a = verify.a;
+const ert = verify.ert;
+const ref = require('./ref-libs/ref');
+
+const charPtrType = ref.refType(ref.types.char);
+
+// Bump pointer allocator for short lived native memory. Allocations are
+// zero filled slices of native blocks, and there is no way to free them
+// one by one: free() releases every block at once, after that none of the
+// Buffers handed out may be used anymore.
+class Arena {
+    constructor(blockSize) {
+        assert(blockSize === undefined || (_.isInteger(blockSize) && blockSize > 0),
+            'Argument "blockSize" is not a positive integer.');
+
+        this.blockSize = blockSize || Arena.defaultBlockSize;
+        this._blocks = [];
+        this._block = null;
+        this._offset = 0;
+        this._size = 0;
+        this._freed = false;
+    }
+
+    get size() {
+        return this._size;
+    }
+
+    get freed() {
+        return this._freed;
+    }
+
+    allocBytes(size, alignment) {
+        assert(!this._freed, 'Arena has been freed.');
+        assert(_.isInteger(size) && size >= 0, 'Argument "size" is not a non-negative integer.');
+        alignment = alignment || 8;
+        a&&ert((alignment & (alignment - 1)) === 0);
+
+        const length = Math.max(size, 1);
+        if (length > this.blockSize / 4) {
+            // Large allocations get their own blocks, not to waste the rest of the current one
+            const block = this._newBlock(length);
+            return block.slice(0, size);
+        }
+        let offset = (this._offset + alignment - 1) & ~(alignment - 1);
+        if (!this._block || offset + length > this._block.length) {
+            this._block = this._newBlock(this.blockSize);
+            offset = 0;
+        }
+        this._offset = offset + length;
+        return this._block.slice(offset, offset + size);
+    }
+
+    // Same as ref.alloc(), but the memory is in the arena.
+    alloc(type, value) {
+        type = ref.coerceType(type);
+        const size = type.indirection === 1 ? type.size : ref.sizeof.pointer;
+        const alignment = type.indirection === 1 ? type.alignment : ref.alignof.pointer;
+        const buffer = this.allocBytes(size, alignment);
+        buffer.type = type;
+        if (arguments.length >= 2) {
+            ref.set(buffer, 0, value, type);
+        }
+        return buffer;
+    }
+
+    // Same as ref.allocCString(), but the memory is in the arena.
+    allocCString(string, encoding) {
+        if (string === null || string === undefined) {
+            return ref.NULL;
+        }
+        const size = Buffer.byteLength(string, encoding);
+        const buffer = this.allocBytes(size + 1, 1);
+        buffer.write(string, 0, size, encoding);
+        buffer.type = charPtrType;
+        return buffer;
+    }
+
+    free() {
+        if (this._freed) {
+            return;
+        }
+        for (const block of this._blocks) {
+            native.arena.freeBlock(block);
+        }
+        this._blocks = [];
+        this._block = null;
+        this._freed = true;
+    }
+
+    _newBlock(size) {
+        const block = native.arena.newBlock(size);
+        this._blocks.push(block);
+        this._size += size;
+        return block;
+    }
+}
+
+Arena.defaultBlockSize = 16 * 1024;
+
+module.exports = Arena;
@@ -0,0 +1,523 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const _ = require('lodash');
+const assert = require('assert');
+const defs = require('./defs');
+const ref = require('./ref-libs/ref');
+const primitives = require('./ref-libs/primitives');
+const scope = require('./scope');
+const Disposable = require('./Disposable');
+const refHelpers = require('./refHelpers');
+const verify = require('./verify');
+const a = verify.a;
+const ert = verify.ert;
+
+// Argument qualifiers of function declarations:
+// - out: the argument is a pointer to a result, fastcall passes a scratch
+//   slot, and returns the value it points to after the call. With length,
+//   a pointer to a single indirection is an output array, returned copied
+// - borrowed (default): an out pointer points to memory owned by the library
+// - owned(freeFunction): an out pointer points to memory that the caller
+//   should release by calling the library's freeFunction(ptr)
+// - arena: the argument is an output buffer, fastcall allocates it from
+//   the arena of the current scope
+// - length(name|N): the item count of an out pointer or arena buffer,
+//   either a constant, or the value of another (in or out) argument
+// - interned: a string argument, whose encoded C string is cached by the
+//   library, so repeated calls pass the same pointer
+const QUALIFIER = /^\s*(out|interned|borrowed|arena|owned\s*\(\s*([\w_][\w\d_]*)\s*\)|length\s*\(\s*([\w_][\w\d_]*|\d+)\s*\))\s+/;
+
+// Function qualifiers, used by synchronized libraries (syncMode.lock):
+// - shared: the function takes the lock in shared (reader) mode, so it
+//   could run concurrently with other shared functions
+// - lockgroup(name): the function takes the lock of the named group
+//   instead of the library's lock
+// and by every library:
+// - concurrency(N): at most N async calls of the function run at once
+const FUNCTION_QUALIFIER = /^\s*(shared|lockgroup\s*\(\s*([\w_][\w\d_]*)\s*\)|concurrency\s*\(\s*(\d+)\s*\))\s+/;
+
+exports.parseFunction = function (def) {
+    a&&ert(_.isString(def));
+
+    const lock = { shared: false, group: null };
+    let maxConcurrency = 0;
+    let match;
+    while ((match = FUNCTION_QUALIFIER.exec(def))) {
+        if (match[2]) {
+            lock.group = match[2];
+        }
+        else if (match[3]) {
+            maxConcurrency = Number(match[3]);
+        }
+        else {
+            lock.shared = true;
+        }
+        def = def.substr(match[0].length);
+    }
+    return { def, lock, maxConcurrency };
+};
+
+exports.lockFromOptions = function (options) {
+    assert(_.isPlainObject(options), 'Function options object expected.');
+    assert(options.lockGroup === undefined || (_.isString(options.lockGroup) && options.lockGroup),
+        'Lock group name expected for "lockGroup".');
+    return { shared: Boolean(options.shared), group: options.lockGroup || null };
+};
+
+exports.concurrencyFromOptions = function (options) {
+    assert(_.isPlainObject(options), 'Function options object expected.');
+    const maxConcurrency = options.maxConcurrency || 0;
+    assert(_.isInteger(maxConcurrency) && maxConcurrency >= 0, 'Number expected for "maxConcurrency".');
+    return maxConcurrency;
+};
+
+exports.lockToString = function (lock) {
+    let result = '';
+    if (lock.shared) {
+        result += 'shared ';
+    }
+    if (lock.group) {
+        result += `lockgroup(${ lock.group }) `;
+    }
+    return result;
+};
+
+exports.parse = function (def) {
+    a&&ert(_.isString(def));
+
+    let qualifiers = null;
+    let match;
+    while ((match = QUALIFIER.exec(def))) {
+        qualifiers = qualifiers || makeQualifiers();
+        const keyword = match[1];
+        if (keyword === 'out') {
+            qualifiers.out = true;
+        }
+        else if (keyword === 'interned') {
+            qualifiers.interned = true;
+        }
+        else if (keyword === 'borrowed' || keyword === 'arena') {
+            setOwnership(qualifiers, keyword);
+        }
+        else if (match[2]) {
+            setOwnership(qualifiers, 'owned');
+            qualifiers.free = match[2];
+        }
+        else {
+            qualifiers.length = /^\d+$/.test(match[3]) ? Number(match[3]) : match[3];
+        }
+        def = def.substr(match[0].length);
+    }
+    return { def, qualifiers };
+};
+
+// node-ffi like format: { type: 'double**', out: true, owned: 'freeNumbers', length: 'size' }
+exports.isSpec = function (spec) {
+    return _.isPlainObject(spec) && spec.type !== undefined && spec.indirection === undefined;
+};
+
+exports.fromSpec = function (spec) {
+    a&&ert(exports.isSpec(spec));
+
+    const qualifiers = makeQualifiers();
+    qualifiers.out = Boolean(spec.out);
+    qualifiers.interned = Boolean(spec.interned);
+    if (spec.borrowed) {
+        setOwnership(qualifiers, 'borrowed');
+    }
+    if (spec.arena) {
+        setOwnership(qualifiers, 'arena');
+    }
+    if (spec.owned) {
+        assert(_.isString(spec.owned), 'Free function name expected for "owned".');
+        setOwnership(qualifiers, 'owned');
+        qualifiers.free = spec.owned;
+    }
+    if (spec.length !== undefined) {
+        assert(_.isString(spec.length) || _.isInteger(spec.length), 'Argument name or number expected for "length".');
+        qualifiers.length = spec.length;
+    }
+    return qualifiers;
+};
+
+exports.toString = function (qualifiers) {
+    let result = '';
+    if (qualifiers.out) {
+        result += 'out ';
+    }
+    if (qualifiers.interned) {
+        result += 'interned ';
+    }
+    if (qualifiers.ownership === 'owned') {
+        result += `owned(${ qualifiers.free }) `;
+    }
+    else if (qualifiers.ownership) {
+        result += qualifiers.ownership + ' ';
+    }
+    if (qualifiers.length !== null) {
+        result += `length(${ qualifiers.length }) `;
+    }
+    return result;
+};
+
+exports.isQualified = function (func) {
+    return func.args.some(arg => arg.qualifiers);
+};
+
+exports.validate = function (func) {
+    for (const arg of func.args) {
+        const q = arg.qualifiers;
+        if (!q) {
+            continue;
+        }
+        const where = `argument "${ arg.name }" of function "${ func.name }"`;
+        if (q.interned) {
+            assert(isStringArg(arg), `Interned ${ where } is not a string.`);
+            assert(!q.out && !q.ownership && q.length === null, `Interned ${ where } cannot have other qualifiers.`);
+            continue;
+        }
+        assert(arg.type.indirection > 1, `Qualified ${ where } is not a pointer.`);
+        if (q.ownership === 'arena') {
+            assert(!q.out, `Arena ${ where } cannot be an out argument.`);
+            assert(q.length !== null, `Arena ${ where } has no length.`);
+        }
+        else {
+            assert(q.out, `Qualified ${ where } is not an out argument.`);
+            if (q.ownership) {
+                assert(arg.type.indirection > 2, `Out ${ where } is not a pointer to pointer.`);
+            }
+        }
+        if (_.isString(q.length)) {
+            const lengthArg = _.find(func.args, other => other.name === q.length);
+            assert(lengthArg && lengthArg !== arg, `Length of ${ where } refers to an unknown argument "${ q.length }".`);
+            const lq = lengthArg.qualifiers;
+            if (q.ownership === 'arena' || isOutArray(arg)) {
+                // the buffer gets allocated before the call
+                assert(!lq || (!lq.out && lq.ownership !== 'arena'), `Length of ${ where } is not an input argument.`);
+            }
+            else if (lq && lq.out) {
+                assert(lengthArg.type.indirection === 2, `Length of ${ where } is not a number.`);
+            }
+        }
+    }
+};
+
+// Turns a function taking every argument to one taking only the inputs
+// and returning { result, <out or arena argument name>: value, ... }.
+// Out arguments are passed in slots of a scratch buffer, reused by the
+// subsequent calls. Scratch buffers are pooled, so reentrant sync calls
+// (from callbacks) and concurrent async calls get their own ones.
+class QualifiedCall {
+    constructor(func) {
+        this.func = func;
+        this.args = func.args;
+        this.hasResult = !(func.resultType.indirection === 1 && !func.resultType.size);
+        this.hasOutputs = this.args.some(isOutput);
+        this._interned = [];
+        this._indexes = {};
+        this._freePtrs = {};
+        this._slots = [];
+        this._scratchSize = 0;
+        this._pool = [];
+        this.args.forEach((arg, i) => {
+            this._indexes[arg.name] = i;
+            if (arg.qualifiers && arg.qualifiers.interned) {
+                this._interned.push(i);
+            }
+            if (arg.qualifiers && arg.qualifiers.out && !isOutArray(arg)) {
+                this._addSlot(i, ref.derefType(arg.type));
+            }
+        });
+    }
+
+    wrap(rawFunction) {
+        const self = this;
+        if (!this.hasOutputs) {
+            // only interned arguments, the result is returned as is
+            return this._compileInterning(rawFunction);
+        }
+        if (this.func.callMode !== defs.callMode.sync) {
+            return function () {
+                const scratch = self._acquire();
+                let promise;
+                try {
+                    const callArgs = self.makeArgs(arguments, scratch);
+                    promise = rawFunction.apply(null, callArgs).then(result => self.makeResult(result, callArgs));
+                }
+                catch (err) {
+                    self._release(scratch);
+                    throw err;
+                }
+                return promise.finally(() => self._release(scratch));
+            };
+        }
+        return function () {
+            const scratch = self._acquire();
+            try {
+                const callArgs = self.makeArgs(arguments, scratch);
+                return self.makeResult(rawFunction.apply(null, callArgs), callArgs);
+            }
+            finally {
+                self._release(scratch);
+            }
+        };
+    }
+
+    makeArgs(inArgs, scratch) {
+        const args = this.args;
+        const callArgs = new Array(args.length);
+        let j = 0;
+        for (let i = 0; i < args.length; i++) {
+            if (!isOutput(args[i])) {
+                callArgs[i] = inArgs[j++];
+            }
+        }
+        this._internStrings(callArgs);
+        scratch.buffer.fill(0);
+        for (const slot of this._slots) {
+            callArgs[slot.index] = scratch.slots[slot.index];
+        }
+        for (let i = 0; i < args.length; i++) {
+            const arg = args[i];
+            const q = arg.qualifiers;
+            if (!q) {
+                continue;
+            }
+            if (isOutArray(arg)) {
+                const itemType = ref.derefType(arg.type);
+                callArgs[i] = scratch.array(i, this._length(q, callArgs) * sizeOf(itemType), itemType);
+            }
+            else if (q.ownership === 'arena') {
+                const itemType = ref.derefType(arg.type);
+                const buffer = scope.arena.allocBytes(this._length(q, callArgs) * sizeOf(itemType), alignmentOf(itemType));
+                buffer.type = itemType;
+                callArgs[i] = buffer;
+            }
+        }
+        return callArgs;
+    }
+
+    // Generates a wrapper of fixed arity (like the ones of CallSignature),
+    // so calls don't allocate an arguments array.
+    _compileInterning(rawFunction) {
+        const funcArgs = this.args.map((arg, i) => 'arg' + i).join(', ');
+        let body = '';
+        for (const index of this._interned) {
+            body += `if (typeof arg${ index } === 'string') { arg${ index } = strings.get(arg${ index }); }`;
+        }
+        body += `return rawFunction(${ funcArgs });`;
+        const factory = new Function('rawFunction', 'strings', `return function (${ funcArgs }) { ${ body } };`);
+        return factory(rawFunction, this.func.library.stringCache);
+    }
+
+    makeResult(result, callArgs) {
+        const args = this.args;
+        const output = {};
+        if (this.hasResult) {
+            output.result = result;
+        }
+        for (let i = 0; i < args.length; i++) {
+            const arg = args[i];
+            const q = arg.qualifiers;
+            if (!q) {
+                continue;
+            }
+            if (isOutArray(arg)) {
+                // the scratch gets reused, so the items are copied
+                const buffer = callArgs[i];
+                output[arg.name] = copyView(makeView(buffer, buffer.type, this._length(q, callArgs)));
+            }
+            else if (q.out) {
+                output[arg.name] = this._outValue(arg, callArgs[i], callArgs);
+            }
+            else if (q.ownership === 'arena') {
+                const buffer = callArgs[i];
+                output[arg.name] = makeView(buffer, buffer.type, this._length(q, callArgs));
+            }
+        }
+        return output;
+    }
+
+    _internStrings(callArgs) {
+        const strings = this.func.library.stringCache;
+        for (const index of this._interned) {
+            const value = callArgs[index];
+            if (_.isString(value)) {
+                callArgs[index] = strings.get(value);
+            }
+        }
+    }
+
+    _addSlot(index, type) {
+        const alignment = alignmentOf(type) || 1;
+        const offset = Math.ceil(this._scratchSize / alignment) * alignment;
+        this._slots.push({ index, offset, size: sizeOf(type), type });
+        this._scratchSize = offset + sizeOf(type);
+    }
+
+    _acquire() {
+        return this._pool.pop() || new Scratch(this._slots, this._scratchSize);
+    }
+
+    _release(scratch) {
+        if (this._pool.length < MAX_POOLED_SCRATCH) {
+            this._pool.push(scratch);
+        }
+    }
+
+    _outValue(arg, buffer, callArgs) {
+        const q = arg.qualifiers;
+        const outType = ref.derefType(arg.type);
+        if (outType.indirection === 1 || (!q.ownership && q.length === null)) {
+            if (refHelpers.isStructType(outType) || refHelpers.isUnionType(outType) || refHelpers.isArrayType(outType)) {
+                // these would be views of the scratch
+                buffer = copyBuffer(buffer);
+            }
+            return ref.get(buffer, 0, outType);
+        }
+        const ptr = ref.readPointer(buffer, 0, 0);
+        if (ref.isNull(ptr)) {
+            return null;
+        }
+        const itemType = ref.derefType(outType);
+        let view;
+        let byteLength = 0;
+        if (q.length !== null) {
+            const length = this._length(q, callArgs);
+            byteLength = length * sizeOf(itemType);
+            view = makeView(ref.reinterpret(ptr, byteLength, 0), itemType, length);
+        }
+        else {
+            view = ptr;
+            view.type = itemType;
+        }
+        if (q.ownership === 'owned') {
+            // Released by the scope, or by the finalizer when the view gets collected
+            const disposable = new Disposable(Disposable.native(this._freePtr(q.free), ptr), byteLength);
+            Object.defineProperty(view, 'disposable', { value: disposable });
+        }
+        return view;
+    }
+
+    _length(q, callArgs) {
+        if (!_.isString(q.length)) {
+            return q.length;
+        }
+        const index = this._indexes[q.length];
+        const lengthArg = this.args[index];
+        const value = callArgs[index];
+        if (lengthArg.qualifiers && lengthArg.qualifiers.out) {
+            return Number(ref.get(value, 0, ref.derefType(lengthArg.type)));
+        }
+        return Number(value);
+    }
+
+    _freePtr(name) {
+        let ptr = this._freePtrs[name];
+        if (!ptr) {
+            ptr = this.func.library.getSymbol(name);
+            assert(ptr, `Free function "${ name }" not found in library "${ this.func.library.path }".`);
+            this._freePtrs[name] = ptr;
+        }
+        return ptr;
+    }
+}
+
+const MAX_POOLED_SCRATCH = 16;
+
+// Out argument slots of a call, and the buffers of its output arrays
+// (those grow to the largest length requested).
+class Scratch {
+    constructor(slots, size) {
+        this.buffer = new Buffer(Math.max(size, 1));
+        this.slots = {};
+        this._arrays = {};
+        for (const slot of slots) {
+            const slotBuffer = this.buffer.slice(slot.offset, slot.offset + slot.size);
+            slotBuffer.type = slot.type;
+            this.slots[slot.index] = slotBuffer;
+        }
+    }
+
+    array(index, byteLength, itemType) {
+        let buffer = this._arrays[index];
+        if (!buffer || buffer.length < byteLength) {
+            buffer = this._arrays[index] = new Buffer(Math.max(byteLength, 1));
+        }
+        buffer = buffer.slice(0, byteLength);
+        buffer.fill(0);
+        buffer.type = itemType;
+        return buffer;
+    }
+}
+
+exports.QualifiedCall = QualifiedCall;
+
+function makeQualifiers() {
+    return { out: false, interned: false, ownership: null, free: null, length: null };
+}
+
+function setOwnership(qualifiers, ownership) {
+    assert(!qualifiers.ownership || qualifiers.ownership === ownership,
+        `Conflicting qualifiers: ${ qualifiers.ownership } and ${ ownership }.`);
+    qualifiers.ownership = ownership;
+}
+
+function isOutArray(arg) {
+    const q = arg.qualifiers;
+    return Boolean(q && q.out && q.length !== null && arg.type.indirection === 2);
+}
+
+function isStringArg(arg) {
+    const type = arg.type;
+    return refHelpers.isStringType(type) || (type.indirection === 2 && ref.derefType(type).size === 1);
+}
+
+function isOutput(arg) {
+    const q = arg.qualifiers;
+    return Boolean(q && (q.out || q.ownership === 'arena'));
+}
+
+function sizeOf(type) {
+    return type.indirection === 1 ? type.size : ref.sizeof.pointer;
+}
+
+function alignmentOf(type) {
+    return type.indirection === 1 ? type.alignment : ref.alignof.pointer;
+}
+
+function copyBuffer(buffer) {
+    const copy = new Buffer(buffer.length);
+    buffer.copy(copy);
+    copy.type = buffer.type;
+    return copy;
+}
+
+function copyView(view) {
+    return Buffer.isBuffer(view) ? copyBuffer(view) : view.slice();
+}
+
+// A TypedArray over the memory for number types, the Buffer itself otherwise.
+function makeView(buffer, itemType, length) {
+    const info = primitives.find(itemType);
+    if (info && info.TypedArray && buffer.byteOffset % info.size === 0) {
+        return new info.TypedArray(buffer.buffer, buffer.byteOffset, length);
+    }
+    buffer.type = itemType;
+    return buffer;
+}
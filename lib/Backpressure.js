@@ -0,0 +1,147 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const _ = require('lodash');
+const Promise = require('bluebird');
+const defs = require('./defs');
+const verify = require('./verify');
+const a = verify.a;
+const ert = verify.ert;
+const CallOptions = require('./CallOptions');
+
+// Bounds the number of pending (submitted, but not yet completed) async calls
+// of a library. Calls over the limit are either rejected by a QueueFullError,
+// or wait for capacity in their priority lanes (the 'wait' policy), waiting
+// calls get rejected if their signal fires or their deadline passes. A batch
+// gets admitted while the limit is not reached, and counts by its size.
+class Backpressure {
+    constructor(library, maxPending, policy) {
+        a&&ert(_.isObject(library));
+        a&&ert(maxPending > 0);
+        a&&ert(policy === 'reject' || policy === 'wait');
+
+        this.library = library;
+        this.maxPending = maxPending;
+        this.policy = policy;
+        this.pending = 0;
+        this.rejected = 0;
+        this._lanes = _.values(defs.priority).map(() => []);
+        this._waiting = 0;
+        this._closedError = null;
+    }
+
+    get waiting() {
+        return this._waiting;
+    }
+
+    wrap(func) {
+        const self = this;
+        return function () {
+            return self.submit(1, func, arguments);
+        };
+    }
+
+    // Calls func by args if weight more calls fit in, or after they do.
+    // Batches get submitted by their call count as their weight.
+    submit(weight, func, args) {
+        if (this._closedError) {
+            CallOptions.take();
+            return Promise.reject(this._closedError);
+        }
+        if (this.pending < this.maxPending) {
+            this.pending += weight;
+            return this._call(weight, func, args);
+        }
+        const options = CallOptions.take();
+        if (this.policy === 'reject') {
+            this.rejected++;
+            return Promise.reject(new CallOptions.QueueFullError(this.library));
+        }
+        const priority = options ? options.priority : defs.priority.default;
+        return new Promise((resolve, reject) => {
+            const waiter = { weight, resolve, reject, unsubscribe: null };
+            const lane = this._lanes[priority];
+            lane.push(waiter);
+            this._waiting++;
+            if (options && (options.signal || options.deadline !== null)) {
+                waiter.unsubscribe = CallOptions.subscribe(this.library, options, err => {
+                    _.pull(lane, waiter);
+                    this._waiting--;
+                    reject(err);
+                });
+            }
+        })
+        .then(() => {
+            // the slot has been taken by _next()
+            CallOptions.set(options);
+            return this._call(weight, func, args);
+        });
+    }
+
+    _call(weight, func, args) {
+        let promise;
+        try {
+            promise = func.apply(null, args);
+        }
+        catch (err) {
+            this._done(weight);
+            throw err;
+        }
+        finally {
+            CallOptions.set(null);
+        }
+        return promise.finally(() => this._done(weight));
+    }
+
+    _done(weight) {
+        this.pending -= weight;
+        this._next();
+    }
+
+    // Rejects the waiting calls by err, and admits no more calls,
+    // called on release before the calls would run on a freed library.
+    close(err) {
+        this._closedError = err;
+        for (const lane of this._lanes) {
+            for (const waiter of lane.splice(0)) {
+                if (waiter.unsubscribe) {
+                    waiter.unsubscribe();
+                }
+                waiter.reject(err);
+            }
+        }
+        this._waiting = 0;
+    }
+
+    _next() {
+        if (this._closedError) {
+            return;
+        }
+        while (this._waiting && this.pending < this.maxPending) {
+            const lane = _.find(this._lanes, lane => lane.length);
+            const waiter = lane.shift();
+            this._waiting--;
+            this.pending += waiter.weight;
+            if (waiter.unsubscribe) {
+                waiter.unsubscribe();
+            }
+            waiter.resolve();
+        }
+    }
+}
+
+module.exports = Backpressure;
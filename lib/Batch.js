@@ -0,0 +1,123 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const _ = require('lodash');
+const assert = require('assert');
+const Promise = require('bluebird');
+const native = require('./native');
+const dyncall = native.dyncall;
+const ArgQualifiers = require('./ArgQualifiers');
+const packedCall = require('./packedCall');
+
+const CALL_DOUBLES = packedCall.CALL_SIZE / 8;
+const MIN_CHUNK_SIZE = 16;
+const DEFAULT_CHUNKS = 4; // the default size of libuv's thread pool
+const toNumber = packedCall.toNumber;
+
+// Makes many async calls of a library by a single native call per gate:
+// they're packed into one buffer (see packedCall), and get dispatched as
+// a few work items. Returns a promise of a Float64Array of their results.
+// funcAt(i) and argsAt(i) give the function and the arguments of the ith call.
+// Calls of functions having their own concurrency limit are dispatched by
+// their gate, a work item counts as one call of it. The batch counts as
+// count calls against the backpressure of the library.
+exports.submit = function (library, count, funcAt, argsAt, options) {
+    options = options || {};
+    assert(options.chunkSize === undefined || (_.isInteger(options.chunkSize) && options.chunkSize > 0),
+        '"options.chunkSize" is invalid.');
+    const results = new Float64Array(count);
+    if (!count) {
+        return Promise.resolve(results);
+    }
+
+    const groups = new Map();
+    let lock;
+    for (let i = 0; i < count; i++) {
+        const func = funcAt(i);
+        const gate = library._getGate(func);
+        let group = groups.get(gate);
+        if (!group) {
+            group = { gate, functions: [], indexes: new Map(), positions: [], referenced: [] };
+            groups.set(gate, group);
+        }
+        if (!group.indexes.has(func)) {
+            group.indexes.set(func, group.functions.length);
+            group.functions.push(packedCall.describe(func));
+            if (library.synchronized) {
+                assert(lock === undefined || ArgQualifiers.lockToString(lock) === ArgQualifiers.lockToString(func.lock),
+                    'Functions of a batch should take the same lock.');
+                lock = func.lock;
+            }
+        }
+        group.positions.push(i);
+    }
+
+    for (const group of groups.values()) {
+        const calls = new Float64Array(group.positions.length * CALL_DOUBLES);
+        const indexSlots = new Uint32Array(calls.buffer);
+        group.positions.forEach((position, n) => {
+            const func = funcAt(position);
+            const args = argsAt(position);
+            assert(args && args.length === func.args.length, `Invalid number of arguments for "${ func.name }".`);
+            const index = group.indexes.get(func);
+            const codes = group.functions[index][1];
+            indexSlots[n * CALL_DOUBLES * 2] = index;
+            const base = n * CALL_DOUBLES + 1;
+            for (let j = 0; j < args.length; j++) {
+                calls[base + j] = toNumber(args[j], codes[j]);
+                if (packedCall.isReferenced(args[j])) {
+                    group.referenced.push(args[j]);
+                }
+            }
+        });
+        group.calls = calls;
+    }
+
+    const run = () => Promise.all(Array.from(groups.values()).map(group => {
+        const groupCount = group.positions.length;
+        const groupResults = groups.size === 1 ? results : new Float64Array(groupCount);
+        const chunkSize = options.chunkSize ||
+            (library.queued ? groupCount : Math.max(Math.ceil(groupCount / DEFAULT_CHUNKS), MIN_CHUNK_SIZE));
+        return new Promise((resolve, reject) => {
+            dyncall.callBatch(
+                group.functions,
+                group.calls,
+                groupCount,
+                groupResults,
+                chunkSize,
+                err => err ? reject(err) : resolve(),
+                library._executor,
+                lock ? library._getLock(lock.group) : null,
+                lock ? lock.shared : false,
+                null,
+                group.gate);
+        })
+        .then(() => {
+            // the memory of pointer arguments is read by the worker threads
+            // until this point, so they're referenced here to keep them alive
+            group.referenced = null;
+            if (groupResults !== results) {
+                group.positions.forEach((position, n) => {
+                    results[position] = groupResults[n];
+                });
+            }
+        });
+    }))
+    .then(() => results);
+
+    return library._backpressure ? library._backpressure.submit(count, run, []) : run();
+};
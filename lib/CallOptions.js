@@ -0,0 +1,227 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const _ = require('lodash');
+const assert = require('assert');
+const Promise = require('bluebird');
+const native = require('./native');
+const dyncall = native.dyncall;
+const defs = require('./defs');
+
+// The error of async calls that have been dropped before execution.
+class CancelledError extends Error {
+    constructor(reason) {
+        super(reason === 'timeout' ? 'Asynchronous call timed out.' : 'Asynchronous call aborted.');
+        this.name = 'CancelledError';
+        this.code = 'ECANCELED';
+        this.reason = reason;
+    }
+}
+
+// The error of async calls rejected by the backpressure of their library.
+class QueueFullError extends Error {
+    constructor(library) {
+        super(`Too many asynchronous calls of library "${ library.path }" are pending.`);
+        this.name = 'QueueFullError';
+        this.code = 'EQUEUEFULL';
+    }
+}
+
+// Options of the async call being made by a func.with(options)(...) wrapper,
+// consumed by the native call of the generated function.
+let current = null;
+
+const CallOptions = {
+    CancelledError,
+    QueueFullError,
+
+    get pending() {
+        return current !== null;
+    },
+
+    take() {
+        const options = current;
+        current = null;
+        return options;
+    },
+
+    set(options) {
+        current = options;
+    },
+
+    // { signal, timeout, deadline, priority }: the signal is anything like
+    // the AbortSignal of the DOM (aborted, addEventListener,
+    // removeEventListener), the timeout is in milliseconds, the deadline is
+    // a Date or a timestamp, the priority is a lane of Library.priority
+    // (or its name).
+    wrap(func, options) {
+        assert(_.isObject(options), 'Argument "options" is not an object.');
+        const signal = options.signal || null;
+        assert(!signal || _.isFunction(signal.addEventListener), '"options.signal" is not an AbortSignal.');
+        let deadline = null;
+        if (options.deadline !== undefined) {
+            deadline = Number(options.deadline);
+            assert(!_.isNaN(deadline), '"options.deadline" is invalid.');
+        }
+        assert(options.timeout === undefined || _.isNumber(options.timeout), '"options.timeout" is not a number.');
+        let priority = defs.priority.default;
+        if (options.priority !== undefined) {
+            priority = _.isString(options.priority) ? defs.priority[options.priority] : options.priority;
+            assert(_.includes(_.values(defs.priority), priority), '"options.priority" is invalid.');
+        }
+        const library = func.function.library;
+        return function () {
+            const callOptions = {
+                signal,
+                deadline: options.timeout !== undefined ? Date.now() + options.timeout : deadline,
+                priority
+            };
+            const error = CallOptions.check(library, callOptions);
+            if (error) {
+                return Promise.reject(error);
+            }
+            current = callOptions;
+            try {
+                return func.apply(null, arguments);
+            }
+            finally {
+                current = null;
+            }
+        };
+    },
+
+    // Returns the CancelledError of a call whose signal has fired or whose
+    // deadline has passed (and counts it), or null.
+    check(library, options) {
+        const reason = expired(options);
+        if (!reason) {
+            return null;
+        }
+        library.cancellations[reason === 'timeout' ? 'timedOut' : 'aborted']++;
+        return new CancelledError(reason);
+    },
+
+    // Calls onCancel(error) when the signal fires or the deadline passes,
+    // returns the function unsubscribing it.
+    subscribe(library, options, onCancel) {
+        const signal = options.signal;
+        let timer = null;
+        const unsubscribe = () => {
+            if (timer) {
+                clearTimeout(timer);
+                timer = null;
+            }
+            if (signal) {
+                signal.removeEventListener('abort', onAbort);
+            }
+        };
+        const cancel = reason => {
+            unsubscribe();
+            library.cancellations[reason === 'timeout' ? 'timedOut' : 'aborted']++;
+            onCancel(new CancelledError(reason));
+        };
+        const onAbort = () => cancel('aborted');
+        if (options.deadline !== null) {
+            timer = setTimeout(() => cancel('timeout'), Math.max(options.deadline - Date.now(), 0));
+        }
+        if (signal) {
+            signal.addEventListener('abort', onAbort);
+        }
+        return unsubscribe;
+    },
+
+    // Makes an async call of the native caller by the current options.
+    // Cancellable calls get dropped if the signal fires or the deadline
+    // passes before their execution begins. Once a call runs, it cannot be
+    // stopped, that's counted as too late.
+    call(caller, library, vm, ptr) {
+        const options = current;
+        current = null;
+        // could have fired while the call was waiting for backpressure
+        const error = CallOptions.check(library, options);
+        if (error) {
+            return Promise.reject(error);
+        }
+        if (!options.signal && options.deadline === null) {
+            return Promise.fromCallback(callback => {
+                dyncall.setCallOptions(false, options.priority);
+                caller(vm, ptr, callback);
+            });
+        }
+        const stats = library.cancellations;
+        return new Promise((resolve, reject) => {
+            const signal = options.signal;
+            let timer = null;
+            let done = false;
+            const cleanup = () => {
+                done = true;
+                if (timer) {
+                    clearTimeout(timer);
+                }
+                if (signal) {
+                    signal.removeEventListener('abort', onAbort);
+                }
+            };
+            const cancel = reason => {
+                if (done) {
+                    return;
+                }
+                if (dyncall.cancel(id)) {
+                    stats[reason === 'timeout' ? 'timedOut' : 'aborted']++;
+                    cleanup();
+                    reject(new CancelledError(reason));
+                }
+                else {
+                    stats.tooLate++;
+                    cleanup();
+                }
+            };
+            const onAbort = () => cancel('aborted');
+
+            dyncall.setCallOptions(true, options.priority);
+            const id = caller(vm, ptr, (err, result) => {
+                if (!done) {
+                    cleanup();
+                }
+                if (err) {
+                    reject(err);
+                }
+                else {
+                    resolve(result);
+                }
+            });
+            if (options.deadline !== null) {
+                timer = setTimeout(() => cancel('timeout'), Math.max(options.deadline - Date.now(), 0));
+            }
+            if (signal) {
+                signal.addEventListener('abort', onAbort);
+            }
+        });
+    }
+};
+
+module.exports = CallOptions;
+
+function expired(options) {
+    if (options.signal && options.signal.aborted) {
+        return 'aborted';
+    }
+    if (options.deadline !== null && options.deadline <= Date.now()) {
+        return 'timeout';
+    }
+    return null;
+}
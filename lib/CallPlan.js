@@ -0,0 +1,245 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const _ = require('lodash');
+const assert = require('assert');
+const Promise = require('bluebird');
+const native = require('./native');
+const ArgQualifiers = require('./ArgQualifiers');
+const packedCall = require('./packedCall');
+
+// Must match src/callplan.h.
+const CHECKS = ['none', 'eq', 'ne', 'lt', 'le', 'gt', 'ge'];
+const SOURCE = { constant: 0, input: 1, result: 2, scratch: 3 };
+const STEP_SIZE = 6 + packedCall.MAX_ARGS * 2;
+const toNumber = packedCall.toNumber;
+
+// Reference to an input of the plan, to the result of a step,
+// or to a scratch slot.
+class Ref {
+    constructor(source, index) {
+        this.source = source;
+        this.index = index;
+    }
+}
+
+// The error of plans having a step whose result has failed its check.
+class CallPlanError extends Error {
+    constructor(step, func, result) {
+        super(`Step ${ step } of the call plan ("${ func.name }") has failed, result: ${ result }.`);
+        this.name = 'CallPlanError';
+        this.code = 'ECALLPLAN';
+        this.step = step;
+        this.function = func.name;
+        this.result = result;
+    }
+}
+
+// A chain of dependent async calls of a library, executed on a worker
+// thread as a whole, without returning to the event loop between the calls.
+// build(plan) declares the steps by plan.call(fn, args, options), where
+// args are numbers, pointers, plan.arg(index) inputs, results of earlier
+// steps and plan.slot(index) scratch slots.
+// options: { check: { ge: 0 }, always: true, into: plan.slot(index) }.
+// The return value of build (a step, or an array of steps) tells the
+// results to resolve with, it's the result of the last step by default.
+// Plans could run synchronously too (call programs, see runSync), then
+// scratch slots keep their values between the runs, otherwise they are
+// temporaries of a run, starting from zero. Slots of the steps that haven't
+// succeeded in a run get reset to zero.
+class CallPlan {
+    constructor(library, build) {
+        this.library = library;
+        this.inputCount = 0;
+        this.scratchCount = 0;
+        this._functions = [];
+        this._descriptors = [];
+        this._steps = [];
+        this._constants = []; // keeps the Buffers of pointer constants alive
+        this._inputCodes = []; // the type codes of the arguments taking the inputs
+        this._lock = undefined;
+
+        let output = build(this);
+        if (output === undefined) {
+            assert(this._steps.length, 'Call plan has no steps.');
+            output = new Ref(SOURCE.result, this._steps.length - 1);
+        }
+        this._output = output;
+
+        const program = new Float64Array(this._steps.length * STEP_SIZE);
+        this._steps.forEach((step, i) => program.set(step, i * STEP_SIZE));
+        this._plan = native.plan.newPlan(this._descriptors, program, this.inputCount, this.scratchCount);
+        this.scratch = new Float64Array(this.scratchCount);
+        this._inputs = null;
+        this._results = null;
+    }
+
+    arg(index) {
+        assert(_.isInteger(index) && index >= 0, 'Argument "index" is invalid.');
+        this.inputCount = Math.max(this.inputCount, index + 1);
+        return new Ref(SOURCE.input, index);
+    }
+
+    slot(index) {
+        assert(_.isInteger(index) && index >= 0, 'Argument "index" is invalid.');
+        this.scratchCount = Math.max(this.scratchCount, index + 1);
+        return new Ref(SOURCE.scratch, index);
+    }
+
+    call(fn, args, options) {
+        assert(!this._plan, 'Call plan is already built.');
+        args = args || [];
+        options = options || {};
+        const func = packedCall.findFunction(this.library, fn);
+        assert(args.length === func.args.length, `Invalid number of arguments for "${ func.name }".`);
+
+        let index = this._functions.indexOf(func);
+        if (index === -1) {
+            index = this._functions.length;
+            this._descriptors.push(packedCall.describe(func));
+            this._functions.push(func);
+            if (this.library.synchronized) {
+                assert(this._lock === undefined ||
+                    ArgQualifiers.lockToString(this._lock) === ArgQualifiers.lockToString(func.lock),
+                    'Functions of a call plan should take the same lock.');
+                this._lock = func.lock;
+            }
+        }
+
+        const codes = this._descriptors[index][1];
+        const step = new Float64Array(STEP_SIZE);
+        step[0] = index;
+        step[1] = args.length;
+        if (options.check) {
+            const keys = _.keys(options.check);
+            assert(keys.length === 1 && CHECKS.indexOf(keys[0]) > 0, 'Option "check" is invalid.');
+            step[2] = CHECKS.indexOf(keys[0]);
+            step[3] = toNumber(options.check[keys[0]], '');
+        }
+        step[4] = options.always ? 1 : 0;
+        if (options.into) {
+            assert(options.into instanceof Ref && options.into.source === SOURCE.scratch, 'Option "into" is not a scratch slot.');
+            step[5] = options.into.index;
+        }
+        else {
+            step[5] = -1;
+        }
+        args.forEach((arg, i) => {
+            if (arg instanceof Ref) {
+                assert(arg.source !== SOURCE.result || arg.index < this._steps.length, 'Invalid step reference.');
+                step[6 + i * 2] = arg.source;
+                step[7 + i * 2] = arg.index;
+                if (arg.source === SOURCE.input) {
+                    this._inputCodes[arg.index] = (this._inputCodes[arg.index] || '') + codes[i];
+                }
+            }
+            else {
+                if (packedCall.isReferenced(arg)) {
+                    this._constants.push(arg);
+                }
+                step[6 + i * 2] = SOURCE.constant;
+                step[7 + i * 2] = toNumber(arg, codes[i]);
+            }
+        });
+        this._steps.push(step);
+        return new Ref(SOURCE.result, this._steps.length - 1);
+    }
+
+    // Runs the plan, returns a promise of its output.
+    run(inputs) {
+        assert(inputs.length === this.inputCount, `Call plan takes ${ this.inputCount } arguments.`);
+        const library = this.library;
+        const lock = this._lock;
+        const numbers = inputs.map((input, i) => toNumber(input, this._inputCodes[i] || ''));
+        return new Promise((resolve, reject) => {
+            native.plan.run(
+                this._plan,
+                numbers,
+                (err, failed, results) => {
+                    // inputs are referenced here to keep their Buffers alive
+                    if (err) {
+                        reject(err);
+                    }
+                    else if (failed >= 0) {
+                        const func = this._functions[this._steps[failed][0]];
+                        reject(new CallPlanError(failed, func, results[failed]));
+                    }
+                    else {
+                        resolve(output(this._output, results, inputs, null));
+                    }
+                },
+                library._executor,
+                lock ? library._getLock(lock.group) : null,
+                lock ? lock.shared : false,
+                null,
+                library._gate);
+        });
+    }
+
+    // Runs the plan synchronously by a single native call, returns its
+    // output, or throws a CallPlanError. Inputs and results are passed in
+    // buffers allocated once, so it's not reentrant.
+    runSync(inputs) {
+        assert(inputs.length === this.inputCount, `Call plan takes ${ this.inputCount } arguments.`);
+        if (!this._results) {
+            this._inputs = new Float64Array(this.inputCount);
+            this._results = new Float64Array(this._steps.length);
+        }
+        for (let i = 0; i < inputs.length; i++) {
+            this._inputs[i] = toNumber(inputs[i], this._inputCodes[i] || '');
+        }
+        const library = this.library;
+        if (library.queued) {
+            library._assertQueueEmpty();
+        }
+        const lock = this._lock;
+        const failed = native.plan.runSync(
+            this._plan,
+            this._inputs,
+            this._results,
+            this.scratch,
+            library._executor,
+            lock ? library._getLock(lock.group) : null,
+            lock ? lock.shared : false);
+        if (failed >= 0) {
+            const func = this._functions[this._steps[failed][0]];
+            throw new CallPlanError(failed, func, this._results[failed]);
+        }
+        return output(this._output, this._results, inputs, this.scratch);
+    }
+}
+
+CallPlan.Error = CallPlanError;
+
+module.exports = CallPlan;
+
+function output(value, results, inputs, scratch) {
+    if (value instanceof Ref) {
+        switch (value.source) {
+            case SOURCE.result:
+                return results[value.index];
+            case SOURCE.input:
+                return inputs[value.index];
+            default:
+                return scratch ? scratch[value.index] : undefined;
+        }
+    }
+    if (_.isArray(value)) {
+        return value.map(item => output(item, results, inputs, scratch));
+    }
+    return value;
+}
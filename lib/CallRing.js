@@ -0,0 +1,189 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const _ = require('lodash');
+const assert = require('assert');
+const Promise = require('bluebird');
+const native = require('./native');
+const packedCall = require('./packedCall');
+
+// Layout of the shared memory (see src/callring.h):
+// - control block (64 bytes): uint32 sqHead, sqTail, cqHead, cqTail, sleeping, waiting
+// - submission ring: capacity packed calls (see packedCall)
+// - completion ring: capacity * 16 bytes: uint32 sequence number, uint32 status, double result
+const HEADER_SIZE = 64;
+const ENTRY_SIZE = packedCall.CALL_SIZE;
+const COMPLETION_SIZE = 16;
+const toNumber = packedCall.toNumber;
+const SQ_TAIL = 1;
+const CQ_HEAD = 2;
+const CQ_TAIL = 3;
+const SLEEPING = 4;
+
+// io_uring like interface of async calls: calls are written to a submission
+// ring, a dedicated native thread makes them in order, and their results
+// get written to a completion ring, that's polled by JS in batches.
+// No promise, closure or native call is made per call.
+class CallRing {
+    constructor(library, options) {
+        assert(typeof SharedArrayBuffer === 'function', 'SharedArrayBuffer is not supported by this version of Node.js.');
+        options = _.defaults(options, { capacity: 4096 });
+        const capacity = options.capacity;
+        assert(_.isInteger(capacity) && capacity > 0 && (capacity & (capacity - 1)) === 0,
+            '"options.capacity" should be a power of 2.');
+
+        this.library = library;
+        this.capacity = capacity;
+        this.buffer = new SharedArrayBuffer(HEADER_SIZE + capacity * (ENTRY_SIZE + COMPLETION_SIZE));
+        this._control = new Int32Array(this.buffer, 0, HEADER_SIZE / 4);
+        this._entries = new Uint32Array(this.buffer, HEADER_SIZE, capacity * ENTRY_SIZE / 4);
+        this._args = new Float64Array(this.buffer, HEADER_SIZE, capacity * ENTRY_SIZE / 8);
+        const cqOffset = HEADER_SIZE + capacity * ENTRY_SIZE;
+        this._completions = new Uint32Array(this.buffer, cqOffset, capacity * COMPLETION_SIZE / 4);
+        this._results = new Float64Array(this.buffer, cqOffset, capacity * COMPLETION_SIZE / 8);
+        this._mask = capacity - 1;
+        this._tail = 0;
+        this._published = 0;
+        this._head = 0;
+        this._functions = new Map();
+        this._argCodes = [];
+        this._keepAlive = new Array(capacity).fill(null); // pointer arguments by slots
+        this._waiting = null;
+        this._rejectWaiting = null;
+        this._ring = native.callRing.newCallRing(this.buffer, capacity);
+    }
+
+    // The number of calls pushed and not polled yet.
+    get pending() {
+        return (this._tail - this._head) >>> 0;
+    }
+
+    // Makes a function callable by the ring, returns its index.
+    // Only functions of number and pointer arguments and results are supported.
+    register(func) {
+        assert(this._ring, 'Call ring has been released.');
+        func = packedCall.findFunction(this.library, func);
+        let index = this._functions.get(func.name);
+        if (index !== undefined) {
+            return index;
+        }
+        const desc = packedCall.describe(func);
+        index = native.callRing.register(this._ring, desc[0], desc[1], desc[2]);
+        assert(index >= 0, `Function "${ func.name }" cannot be called by a call ring.`);
+        this._functions.set(func.name, index);
+        this._argCodes[index] = desc[1];
+        return index;
+    }
+
+    // push(funcIndex, ...args): writes a call to the submission ring,
+    // returns its sequence number, or -1 if the ring is full.
+    // Pointers are passed as addresses, or as Buffers, TypedArrays and array
+    // buffers, those are kept alive until the completion of the call is polled.
+    push(funcIndex) {
+        const argCount = arguments.length - 1;
+        const codes = this._argCodes[funcIndex];
+        assert(codes !== undefined && argCount === codes.length, `Invalid number of arguments for function ${ funcIndex }.`);
+        if (((this._tail - this._head) >>> 0) >= this.capacity) {
+            return -1;
+        }
+        const slot = this._tail & this._mask;
+        this._entries[slot * (ENTRY_SIZE / 4)] = funcIndex;
+        const base = slot * (ENTRY_SIZE / 8) + 1;
+        let referenced = null;
+        for (let i = 0; i < argCount; i++) {
+            const arg = arguments[i + 1];
+            this._args[base + i] = toNumber(arg, codes[i]);
+            if (packedCall.isReferenced(arg)) {
+                (referenced || (referenced = [])).push(arg);
+            }
+        }
+        this._keepAlive[slot] = referenced;
+        const seq = this._tail;
+        this._tail = (this._tail + 1) >>> 0;
+        return seq;
+    }
+
+    // Publishes the pushed calls, wakes up the thread if it's sleeping.
+    submit() {
+        if (this._published === this._tail) {
+            return;
+        }
+        this._published = this._tail;
+        Atomics.store(this._control, SQ_TAIL, this._tail | 0);
+        if (Atomics.load(this._control, SLEEPING)) {
+            native.callRing.notify(this._ring);
+        }
+    }
+
+    // Calls callback(seq, result, status) by the completed calls,
+    // status is 0 on success. Returns the number of completions.
+    poll(callback) {
+        const tail = Atomics.load(this._control, CQ_TAIL) >>> 0;
+        let head = this._head;
+        let count = 0;
+        while (head !== tail) {
+            const slot = head & this._mask;
+            // calls complete in order, so it's the slot of the call's submission
+            this._keepAlive[slot] = null;
+            callback(this._completions[slot * 4], this._results[slot * 2 + 1], this._completions[slot * 4 + 1]);
+            head = (head + 1) >>> 0;
+            count++;
+        }
+        this._head = head;
+        Atomics.store(this._control, CQ_HEAD, head | 0);
+        return count;
+    }
+
+    // Returns a promise that gets resolved when there are completions to poll.
+    wait() {
+        assert(this._ring, 'Call ring has been released.');
+        if ((Atomics.load(this._control, CQ_TAIL) >>> 0) !== this._head) {
+            return Promise.resolve();
+        }
+        if (!this._waiting) {
+            this._waiting = new Promise((resolve, reject) => {
+                this._rejectWaiting = reject;
+                native.callRing.wait(this._ring, () => {
+                    this._waiting = null;
+                    this._rejectWaiting = null;
+                    resolve();
+                });
+            });
+        }
+        return this._waiting;
+    }
+
+    // Waits for the submitted calls to complete, stops the thread.
+    // A pending wait() gets rejected.
+    release() {
+        if (!this._ring) {
+            return;
+        }
+        this.submit();
+        native.callRing.freeCallRing(this._ring);
+        this._ring = null;
+        this._keepAlive.fill(null);
+        if (this._rejectWaiting) {
+            const reject = this._rejectWaiting;
+            this._waiting = null;
+            this._rejectWaiting = null;
+            reject(new Error('Call ring has been released.'));
+        }
+    }
+}
+
+module.exports = CallRing;
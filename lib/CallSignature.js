@@ -0,0 +1,380 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const _ = require('lodash');
+const assert = require('assert');
+const Promise = require('bluebird');
+const native = require('./native');
+const dyncall = native.dyncall;
+const defs = require('./defs');
+const verify = require('./verify');
+const a = verify.a;
+const ert = verify.ert;
+const ref = require('./ref-libs/ref');
+const refHelpers = require('./refHelpers');
+const ArgQualifiers = require('./ArgQualifiers');
+const CallOptions = require('./CallOptions');
+
+const defIds = new WeakMap();
+let nextDefId = 0;
+
+// State shared by every function of a library that has the same call mode
+// and marshals its arguments and result the same way: the argument setters,
+// the compiled wrapper factory and, in sync mode, the call VM.
+// Functions differ only by their pointer (and result type).
+// Calls of measured signatures (used by adaptive functions) report their
+// native execution time to the stats of the function, async calls of gated
+// ones (having a concurrency limit) get admitted by the gate of the function.
+class CallSignature {
+    constructor(library, func, callMode, measured) {
+        a&&ert(_.isObject(library));
+        a&&ert(_.isObject(func));
+        a&&ert(callMode === defs.callMode.sync || callMode === defs.callMode.async);
+
+        this.library = library;
+        this.callMode = callMode;
+        this.measured = Boolean(measured);
+        this.gated = CallSignature._isGated(func, callMode);
+        this.vmArgSetters = func.args.map(arg => CallSignature._findVMSetterFunc(func, arg.type));
+        this.caller = CallSignature._findCaller(func, callMode);
+        this.vmSize = library.options.vmSize || CallSignature.computeVMSize(func.args);
+        this.lock = library.synchronized ? func.lock : null;
+        this._vm = null;
+        this._ctx = null;
+        this._factory = null;
+    }
+
+    static keyOf(func, callMode, measured) {
+        const caller = CallSignature._findCaller(func, callMode);
+        const gated = CallSignature._isGated(func, callMode);
+        let key = `${ callMode }${ measured ? '~' : '' }${ gated ? '!' : '' }:${ caller.name }(`;
+        if (func.library.synchronized) {
+            key = ArgQualifiers.lockToString(func.lock) + key;
+        }
+        for (const arg of func.args) {
+            const setter = CallSignature._findVMSetterFunc(func, arg.type);
+            key += setter.name + CallSignature._specKeyOf(setter.type) + ',';
+        }
+        return key + ')';
+    }
+
+    static computeVMSize(args) {
+        // Every argument occupies at least a pointer sized slot on the stack,
+        // and some ABIs reserve a home area for register arguments.
+        let size = 32;
+        for (const arg of args) {
+            const type = arg.type;
+            const argSize = type.indirection > 1 ? ref.sizeof.pointer : type.size || ref.sizeof.pointer;
+            size += Math.ceil(Math.max(argSize, 8) / 8) * 8;
+        }
+        return Math.max(size, 64);
+    }
+
+    makeFunction(ptr, resultType, stats, gate) {
+        a&&ert(ptr instanceof Buffer);
+        a&&ert(!this.measured || stats instanceof Buffer);
+        a&&ert(!this.gated || gate instanceof Buffer);
+        if (!this._factory) {
+            this._factory = this._compile();
+        }
+        const derefType = this.caller.isPtr ? ref.derefType(resultType) : null;
+        return this._factory(this._ctx, ptr, derefType, stats || null, gate || null);
+    }
+
+    release() {
+        if (this._vm) {
+            dyncall.free(this._vm);
+            this._vm = null;
+        }
+    }
+
+    _compile() {
+        if (this.callMode === defs.callMode.async) {
+            return this._compileAsync();
+        }
+        return this._compileSync();
+    }
+
+    _compileSync() {
+        const vmArgSetters = this.vmArgSetters;
+        const funcArgs = _.range(vmArgSetters.length).map(n => 'arg' + n);
+        let funcBody = this._setVMCode('ctx.vm');
+        for (let i = 0; i < vmArgSetters.length; i++) {
+            funcBody += `ctx.argSetter${ i }(arg${ i });`;
+        }
+        const returnResult = this.caller.isPtr ?
+            'var result = ctx.callerFunc(ptr); result.type = derefType; return result;' :
+            'return ctx.callerFunc(ptr);';
+        if (this.library.queued) {
+            funcBody += 'ctx.library._assertQueueEmpty();';
+        }
+        funcBody += returnResult;
+
+        const self = this;
+        this._vm = dyncall.newCallVM(this.vmSize);
+
+        class Ctx {
+            constructor() {
+                this.library = self.library;
+                this.executor = self.library._executor;
+                this.lock = self.lock ? self.library._getLock(self.lock.group) : null;
+                this.vm = self._vm;
+                this.setVM = dyncall.setVMAndReset;
+                let i = 0;
+                for (const setter of vmArgSetters) {
+                    const specPtrDef = setter.type.callback ||
+                            setter.type.struct ||
+                            setter.type.union ||
+                            setter.type.array;
+                    if (specPtrDef) {
+                        this['argSetter' + i++] = value => {
+                            setter.func(specPtrDef.makePtr(value));
+                        };
+                    }
+                    else if (refHelpers.isArrayType(setter.type)) {
+                        this['argSetter' + i++] = value => {
+                            setter.func(CallSignature._makeArrayPtr(value));
+                        };
+                    }
+                    else if (refHelpers.isFunctionType(setter.type)) {
+                        this['argSetter' + i++] = value => {
+                            setter.func(self._makeCallbackPtr(value));
+                        };
+                    }
+                    else if (refHelpers.isStringType(setter.type)) {
+                        this['argSetter' + i++] = value => {
+                            setter.func(CallSignature._makeStringPtr(value));
+                        };
+                    }
+                    else {
+                        this['argSetter' + i++] = setter.func;
+                    }
+                }
+                this.callerFunc = self.caller.func;
+            }
+        }
+
+        this._ctx = new Ctx();
+        return CallSignature._makeFactory(funcArgs, funcBody);
+    }
+
+    _compileAsync() {
+        const vmArgSetters = this.vmArgSetters;
+        const hasPtrArg = Boolean(_(vmArgSetters).filter(setter => refHelpers.isPointerType(setter.type)).head());
+        const funcArgs = _.range(vmArgSetters.length).map(n => 'arg' + n);
+        let funcBody = hasPtrArg ? 'var ptrs = [];' : '';
+        funcBody += 'var myVM = ctx.newCallVM(ctx.vmSize);';
+        funcBody += this._setVMCode('myVM');
+        for (let i = 0; i < vmArgSetters.length; i++) {
+            const setter = vmArgSetters[i];
+            if (refHelpers.isPointerType(setter.type)) {
+                funcBody += `ctx.argSetter${ i }(arg${ i }, ptrs);`;
+            }
+            else {
+                funcBody += `ctx.argSetter${ i }(arg${ i });`;
+            }
+        }
+
+        let finallyCode = '{';
+        if (hasPtrArg) {
+            finallyCode += 'ptrs = null;';
+        }
+        finallyCode += '}';
+
+        const setResultType = this.caller.isPtr ? '.then(result => { result.type = derefType; return result; })' : '';
+        const call = '(ctx.callOptions.pending ? ctx.callWithOptions(myVM, ptr) : ctx.callerFunc(myVM, ptr))';
+        funcBody += `return ${ call }${ setResultType }.finally(() => ${ finallyCode });`;
+
+        const self = this;
+
+        class Ctx {
+            constructor() {
+                this.library = self.library;
+                this.executor = self.library._executor;
+                this.lock = self.lock ? self.library._getLock(self.lock.group) : null;
+                this.vmSize = self.vmSize;
+                this.newCallVM = dyncall.newCallVM;
+                this.setVM = dyncall.setVM;
+                let i = 0;
+                for (const setter of vmArgSetters) {
+                    if (refHelpers.isPointerType(setter.type)) {
+                        const specPtrDef = setter.type.callback ||
+                                setter.type.struct ||
+                                setter.type.union ||
+                                setter.type.array;
+                        if (specPtrDef) {
+                            this['argSetter' + i++] = (value, ptrs) => {
+                                const ptr = specPtrDef.makePtr(value);
+                                ptrs.push(ptr);
+                                setter.func(ptr);
+                            };
+                        }
+                        else if (refHelpers.isArrayType(setter.type)) {
+                            this['argSetter' + i++] = (value, ptrs) => {
+                                const ptr = CallSignature._makeArrayPtr(value);
+                                ptrs.push(ptr);
+                                setter.func(ptr);
+                            };
+                        }
+                        else if (refHelpers.isFunctionType(setter.type)) {
+                            this['argSetter' + i++] = (value, ptrs) => {
+                                const ptr = self._makeCallbackPtr(value);
+                                ptrs.push(ptr);
+                                setter.func(ptr);
+                            };
+                        }
+                        else if (refHelpers.isStringType(setter.type)) {
+                            this['argSetter' + i++] = (value, ptrs) => {
+                                const ptr = CallSignature._makeStringPtr(value);
+                                ptrs.push(ptr);
+                                setter.func(ptr);
+                            };
+                        }
+                        else {
+                            this['argSetter' + i++] = (value, ptrs) => {
+                                ptrs.push(value);
+                                setter.func(value);
+                            };
+                        }
+                    }
+                    else {
+                        this['argSetter' + i++] = setter.func;
+                    }
+                }
+                this.callerFunc = Promise.promisify(self.caller.func);
+                this.callOptions = CallOptions;
+                this.callWithOptions = (vm, ptr) => CallOptions.call(self.caller.func, self.library, vm, ptr);
+            }
+        }
+
+        this._ctx = new Ctx();
+        return CallSignature._makeFactory(funcArgs, funcBody);
+    }
+
+    // setVM(vm, executor, lock, shared, stats, gate): calls of queued
+    // libraries run on their executor's thread, those of synchronized ones
+    // take the lock natively (async ones on the thread executing them).
+    _setVMCode(vm) {
+        const args = [
+            vm,
+            this.library.queued ? 'ctx.executor' : 'null',
+            this.lock ? 'ctx.lock' : 'null',
+            this.lock ? String(this.lock.shared) : 'false',
+            this.measured ? 'stats' : 'null',
+            this.gated ? 'gate' : 'null'
+        ];
+        while (args.length > 1 && (_.last(args) === 'null' || _.last(args) === 'false')) {
+            args.pop();
+        }
+        return `ctx.setVM(${ args.join(', ') });`;
+    }
+
+    static _makeFactory(funcArgs, funcBody) {
+        const factoryBody = `return function (${ funcArgs.join(', ') }) { ${ funcBody } };`;
+        try {
+            return new Function('ctx', 'ptr', 'derefType', 'stats', 'gate', factoryBody);
+        }
+        catch (err) {
+            throw Error('Invalid function body: ' + funcBody);
+        }
+    }
+
+    static _isGated(func, callMode) {
+        return callMode === defs.callMode.async &&
+            Boolean(func.library.options.maxConcurrency || func.maxConcurrency);
+    }
+
+    static _findVMSetterFunc(func, type) {
+        return func.findFastcallFunc(dyncall, 'arg', type);
+    }
+
+    static _findCaller(func, callMode) {
+        let name;
+        let isPtr = false;
+        if (func.resultType.indirection > 1) {
+            name = 'callPointer';
+            isPtr = true;
+        }
+        else {
+            name = 'call' + func.toFastcallName(func.resultType.name);
+        }
+        if (callMode === defs.callMode.async) {
+            name += 'Async';
+        }
+
+        const callerFunc = dyncall[name];
+        a&&ert(_.isFunction(callerFunc));
+        return { name, isPtr, func: callerFunc };
+    }
+
+    static _specKeyOf(type) {
+        const specPtrDef = type.callback || type.struct || type.union || type.array;
+        if (specPtrDef) {
+            let id = defIds.get(specPtrDef);
+            if (id === undefined) {
+                id = nextDefId++;
+                defIds.set(specPtrDef, id);
+            }
+            return '#' + id;
+        }
+        if (refHelpers.isArrayType(type)) {
+            return '[]';
+        }
+        if (refHelpers.isFunctionType(type)) {
+            return '()';
+        }
+        if (refHelpers.isStringType(type)) {
+            return '""';
+        }
+        return '';
+    }
+
+    static _makeArrayPtr(value) {
+        if (value === null) {
+            return null;
+        }
+        if (refHelpers.isPointerLike(value)) {
+            return value;
+        }
+        assert(value.buffer instanceof Buffer, 'Argument is not a Buffer.');
+        return value.buffer;
+    }
+
+    _makeCallbackPtr(value) {
+        if (value === null) {
+            return null;
+        }
+        if (value._makePtr) {
+            return value._makePtr(this.library);
+        }
+        assert(refHelpers.isPointerLike(value), 'Argument is not a Buffer.');
+        return value;
+    }
+
+    static _makeStringPtr(value) {
+        if (value === null) {
+            return null;
+        }
+        if (_.isString(value)) {
+            return native.makeStringBuffer(value);
+        }
+        assert(refHelpers.isPointerLike(value), 'Argument is not a Buffer.');
+        return value;
+    }
+}
+
+module.exports = CallSignature;
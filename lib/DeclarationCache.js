@@ -0,0 +1,138 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const _ = require('lodash');
+const assert = require('assert');
+const crypto = require('crypto');
+const fs = require('fs');
+const path = require('path');
+const debug = require('debug')('fastcall:DeclarationCache');
+const version = require('../package.json').version;
+
+// Results of splitting and matching declaration strings, the textual function
+// signatures, and the struct and union layouts, persisted per library so the
+// same headers don't have to be tokenized and laid out on every process start.
+// The file is thrown away when fastcall's version or the library's path or
+// modification time changes.
+class DeclarationCache {
+    constructor(dir, libPath) {
+        assert(_.isString(dir) && dir, 'Argument "dir" is not a string.');
+
+        this.dir = dir;
+        this.libPath = libPath || '';
+        this.file = path.join(dir, `fastcall-${ hash(this.libPath) }.json`);
+        this._entries = null;
+        this._dirty = false;
+    }
+
+    match(kind, str, matchFunc) {
+        let result = this.lookup(kind, str);
+        if (result === undefined) {
+            result = matchFunc(str);
+            if (result === undefined) {
+                result = null;
+            }
+            this.store(kind, str, result);
+        }
+        return result;
+    }
+
+    lookup(kind, str) {
+        return this._load()[kind + ':' + hash(str)];
+    }
+
+    store(kind, str, value) {
+        this._load()[kind + ':' + hash(str)] = value;
+        this._dirty = true;
+    }
+
+    save() {
+        if (!this._dirty) {
+            return;
+        }
+        const content = JSON.stringify({
+            version,
+            path: this.libPath,
+            mtime: libMTime(this.libPath),
+            entries: this._entries
+        });
+        const tmpFile = `${ this.file }.${ process.pid }.tmp`;
+        try {
+            ensureDir(this.dir);
+            fs.writeFileSync(tmpFile, content);
+            fs.renameSync(tmpFile, this.file);
+            this._dirty = false;
+        }
+        catch (err) {
+            debug(`cannot write declaration cache "${ this.file }": ${ err.message }`);
+        }
+    }
+
+    _load() {
+        if (this._entries) {
+            return this._entries;
+        }
+        this._entries = {};
+        let data;
+        try {
+            data = JSON.parse(fs.readFileSync(this.file, 'utf8'));
+        }
+        catch (err) {
+            debug(`declaration cache "${ this.file }" is not available`);
+            return this._entries;
+        }
+        if (data &&
+            data.version === version &&
+            data.path === this.libPath &&
+            data.mtime === libMTime(this.libPath) &&
+            _.isPlainObject(data.entries)) {
+            this._entries = data.entries;
+            debug(`declaration cache "${ this.file }" loaded`);
+        }
+        else {
+            debug(`declaration cache "${ this.file }" is stale`);
+        }
+        return this._entries;
+    }
+}
+
+module.exports = DeclarationCache;
+
+function hash(str) {
+    return crypto.createHash('sha1').update(str).digest('hex');
+}
+
+function libMTime(libPath) {
+    try {
+        return fs.statSync(libPath).mtime.getTime();
+    }
+    catch (err) {
+        // Bare library names are resolved by the loader, we cannot stat them.
+        return 0;
+    }
+}
+
+function ensureDir(dir) {
+    try {
+        fs.mkdirSync(dir);
+    }
+    catch (err) {
+        if (err.code !== 'EEXIST') {
+            throw err;
+        }
+    }
+}
@@ -20,6 +20,7 @@ const scope = require('./scope');
 const native = require('./native');
 const weak = native.weak;
 const assert = require('assert');
+const ref = require('./ref-libs/ref');
 
 class Disposable {
     constructor(disposeFunction, approxExternalMemoryUse) {
@@ -58,32 +59,87 @@ LegacyDisposable.prototype.resetDisposable = function (disposeFunction, approxEx
     this._disposed = false;
 };
 
+// JS dispose functions of the registered objects, by registry id. The native
+// registry calls back with the ids of collected objects in batches.
+const disposeFunctions = new Map();
+
+weak.setFinalizerCallback(ids => {
+    let error = null;
+    for (const id of ids) {
+        const disposeFunction = disposeFunctions.get(id);
+        if (disposeFunction) {
+            disposeFunctions.delete(id);
+            try {
+                disposeFunction();
+            }
+            catch (err) {
+                error = error || err;
+            }
+        }
+    }
+    if (error) {
+        throw error;
+    }
+});
+
 function watch(obj, disposeFunction, approxExternalMemoryUse = 0) {
-    let disposed = false;
     assertDisposeFunction(disposeFunction);
-    const weakCallback = () => {
-        if (disposed) {
+    if (!disposeFunction) {
+        return null;
+    }
+    const isNative = disposeFunction instanceof NativeDisposer;
+    let id = weak.register(
+        obj,
+        isNative ? disposeFunction.func : null,
+        isNative ? disposeFunction.data : null,
+        approxExternalMemoryUse,
+        !isNative);
+    if (!isNative) {
+        disposeFunctions.set(id, disposeFunction);
+    }
+    return () => {
+        if (id === null) {
             return;
         }
-        let result;
-        if (disposeFunction) {
-            result = disposeFunction();
-            if (approxExternalMemoryUse > 0) {
-                weak.adjustExternalMemory(-approxExternalMemoryUse);
-            }
+        const alive = weak.unregister(id, true);
+        const disposeFunctionOfId = alive ? disposeFunctions.get(id) : null;
+        if (disposeFunctionOfId) {
+            disposeFunctions.delete(id);
+        }
+        id = null;
+        if (disposeFunctionOfId) {
+            return disposeFunctionOfId();
         }
-        disposed = true;
-        return result;
     };
-    weak.watch(obj, weakCallback);
-    if (disposeFunction && approxExternalMemoryUse > 0) {
-        weak.adjustExternalMemory(approxExternalMemoryUse);
+}
+
+// A native dispose function (void (*)(void*)) with its argument, freed without
+// calling into JS when the object gets collected.
+class NativeDisposer {
+    constructor(func, data) {
+        assert(func instanceof Buffer && !ref.isNull(func), 'Argument "func" is not a function pointer.');
+        assert(data === undefined || data === null || data instanceof Buffer, 'Argument "data" is not a pointer.');
+
+        this.func = func;
+        this.data = data || null;
     }
-    return weakCallback;
 }
 
+Disposable.native = function (func, data) {
+    return new NativeDisposer(func, data);
+};
+
+// Processes the collected objects right away, instead of on the next loop iteration.
+Disposable.flush = function () {
+    weak.flush();
+};
+
+Disposable.stats = function () {
+    return weak.stats();
+};
+
 function assertDisposeFunction(disposeFunction) {
-    assert(_.isFunction(disposeFunction) || disposeFunction === null,
+    assert(_.isFunction(disposeFunction) || disposeFunction instanceof NativeDisposer || disposeFunction === null,
         'Missing disposeFunction argument. This functiion should release native resources. Please note that this dispose method has no ' +
         'parameters, and only allowed to capture native handles from the source object, not a reference of the source itself, ' +
         'because that would prevent garbage collection! Refer to fastcall readme at Github for more information.');
@@ -58,6 +58,7 @@ class FastCallback extends FunctionDefinition {
                 return value;
             }
             if (_.isFunction(value)) {
+                this.library.initialize();
                 const ptr = native.callback.makePtr(this, this.library._loop, this.signature, this.execute, value);
                 a&&ert(ptr.callback === this);
                 ptr.type = this.type;
@@ -30,251 +30,176 @@ const a = verify.a;
 const ert = verify.ert;
 const ref = require('./ref-libs/ref');
 const refHelpers = require('./refHelpers');
+const ArgQualifiers = require('./ArgQualifiers');
+const CallOptions = require('./CallOptions');
+const Batch = require('./Batch');
 
 class FastFunction extends FunctionDefinition {
     constructor(library, def, callMode, ptr) {
         assert(_.isObject(library), '"library" is not an object.');
-        assert(callMode === defs.callMode.sync || callMode === defs.callMode.async, '"callMode" is invalid: ' + callMode);
+        assert(callMode === defs.callMode.sync ||
+            callMode === defs.callMode.async ||
+            callMode === defs.callMode.adaptive, '"callMode" is invalid: ' + callMode);
         super(library, def);
         this.callMode = callMode;
         this._ptr = ptr;
-        this._vm = null;
+        this._signature = null;
         this._function = null;
-        this._other = null;
+        this._stub = null;
+        this._others = {};
+        this._stats = callMode === defs.callMode.adaptive ? new Buffer(4 * 8).fill(0) : null;
         this._type.function = this;
+        ArgQualifiers.validate(this);
+        this._qualifiedCall = ArgQualifiers.isQualified(this) ? new ArgQualifiers.QualifiedCall(this) : null;
+    }
+
+    get initialized() {
+        return Boolean(this._function);
+    }
+
+    // Decisions of adaptive functions: the estimated native execution time
+    // (exponentially weighted moving average), the number of measured calls,
+    // and the number of calls made inline and offloaded to a thread.
+    get stats() {
+        if (!this._stats) {
+            return null;
+        }
+        return {
+            latency: this._stats.readDoubleLE(0) / 1000,
+            samples: this._stats.readDoubleLE(8),
+            syncCalls: this._stats.readDoubleLE(16),
+            asyncCalls: this._stats.readDoubleLE(24)
+        };
     }
 
     initialize() {
+        if (this._function) {
+            return;
+        }
+        this.library.initialize();
         if (!this._ptr) {
             this._ptr = dynload.findSymbol(this.library._pLib, this.name);
         }
         assert(this._ptr, `Symbol "${ this.name }" not found in library "${ this.library.path }".`);
-        this._vm = dyncall.newCallVM(this.library.options.vmSize);
-        this._function = this._makeFunction();
+        let func;
+        if (this.callMode === defs.callMode.adaptive) {
+            func = this._makeAdaptive();
+        }
+        else {
+            this._signature = this.library._getSignature(this, this.callMode);
+            func = this._signature.makeFunction(this._ptr, this.resultType, null, this._gate(this._signature));
+        }
+        if (this._qualifiedCall) {
+            func = this._qualifiedCall.wrap(func);
+        }
+        if (this.callMode !== defs.callMode.sync && this.library._backpressure) {
+            func = this.library._backpressure.wrap(func);
+        }
+        this._function = this._initFunction(func);
+        if (this._stub && this.library.interface[this.name] === this._stub) {
+            // The stub has done its job, callers going through the interface
+            // should hit the generated function directly from now on.
+            this.library.interface[this.name] = this._function;
+        }
     }
 
-    release() {
-        dyncall.free(this._vm);
+    link(ptr) {
+        a&&ert(ptr instanceof Buffer);
+        if (!this._ptr) {
+            this._ptr = ptr;
+        }
+        for (const other of _.values(this._others)) {
+            other.link(ptr);
+        }
     }
 
     getFunction() {
-        assert(this._function, this.name + ' is not initialized.');
-        return this._function;
+        if (this._function) {
+            return this._function;
+        }
+        assert(this.library.options.lazy, this.name + ' is not initialized.');
+        if (!this._stub) {
+            this._stub = this._makeStub();
+        }
+        return this._stub;
     }
 
     sync() {
         if (this.callMode === defs.callMode.sync) {
             return this.getFunction();
         }
-        if (!this._other) {
-            this._other = new FastFunction(this.library, this, defs.callMode.sync, this._ptr);
-            this._other.initialize();
-        }
-        return this._other.getFunction();
+        return this._getOther(defs.callMode.sync);
     }
 
     async() {
         if (this.callMode === defs.callMode.async) {
             return this.getFunction();
         }
-        if (!this._other) {
-            this._other = new FastFunction(this.library, this, defs.callMode.async, this._ptr);
-            this._other.initialize();
-        }
-        return this._other.getFunction();
+        return this._getOther(defs.callMode.async);
     }
 
-    _makeFunction() {
-        if (this.callMode === defs.callMode.async) {
-            return this._makeAsyncFunction();
-        }
-        return this._makeSyncFunction();
+    with(options) {
+        assert(this.callMode !== defs.callMode.sync, 'Only asynchronous calls could be cancelled.');
+        return CallOptions.wrap(this.getFunction(), options);
     }
 
-    _makeSyncFunction() {
-        const vmArgSetters = this.args.map(arg => this._findVMSetterFunc(arg.type));
-        const funcArgs = _.range(vmArgSetters.length).map(n => 'arg' + n);
-        let funcBody = 'this.setVM(this.vm);';
-        for (let i = 0; i < vmArgSetters.length; i++) {
-            funcBody += `this.argSetter${ i }(arg${ i });`;
-        }
-        if (this.library.synchronized) {
-            funcBody += 'this.library._lock();';
-            funcBody += 'try {';
-            funcBody += 'return this.callerFunc();';
-            funcBody += '}';
-            funcBody += 'finally {';
-            funcBody += 'this.library._unlock();';
-            funcBody += '}';
-        }
-        else {
-            if (this.library.queued) {
-                funcBody += 'this.library._assertQueueEmpty();';
-            }
-            funcBody += 'return this.callerFunc();';
-        }
-
-        class Ctx {
-            constructor(fn) {
-                this.library = fn.library;
-                this.vm = fn._vm;
-                this.setVM = dyncall.setVMAndReset;
-                let i = 0;
-                for (const setter of vmArgSetters) {
-                    const specPtrDef = setter.type.callback ||
-                            setter.type.struct ||
-                            setter.type.union ||
-                            setter.type.array;
-                    if (specPtrDef) {
-                        this['argSetter' + i++] = value => {
-                            setter.func(specPtrDef.makePtr(value));
-                        };
-                    }
-                    else if (refHelpers.isArrayType(setter.type)) {
-                        this['argSetter' + i++] = value => {
-                            setter.func(FastFunction._makeArrayPtr(value));
-                        };
-                    }
-                    else if (refHelpers.isFunctionType(setter.type)) {
-                        this['argSetter' + i++] = value => {
-                            setter.func(fn._makeCallbackPtr(value));
-                        };
-                    }
-                    else if (refHelpers.isStringType(setter.type)) {
-                        this['argSetter' + i++] = value => {
-                            setter.func(fn._makeStringPtr(value));
-                        };
-                    }
-                    else {
-                        this['argSetter' + i++] = setter.func;
-                    }
-                }
-                this.callerFunc = fn._makeCallerFunc();
-            }
-        }
-
-        let innerFunc;
-        try {
-            const innerFuncArgs = funcArgs.concat([funcBody]);
-            innerFunc = new Function(...innerFuncArgs);
-        }
-        catch (err) {
-            throw Error('Invalid function body: ' + funcBody);
-        }
-        const ctx = new Ctx(this);
-        const func = function () {
-            return innerFunc.apply(ctx, arguments);
-        };
-        return this._initFunction(func);
+    // Makes a call by each arguments array asynchronously in one go,
+    // see Library.submitBatch().
+    many(argsList, options) {
+        assert(_.isArray(argsList), 'Argument "argsList" is not an array.');
+        this.library.initialize();
+        return Batch.submit(this.library, argsList.length, () => this, i => argsList[i], options);
     }
 
-    _makeAsyncFunction() {
-        const vmArgSetters = this.args.map(arg => this._findVMSetterFunc(arg.type));
-        const hasPtrArg = Boolean(_(vmArgSetters).filter(setter => refHelpers.isPointerType(setter.type)).head());
-        const funcArgs = _.range(vmArgSetters.length).map(n => 'arg' + n);
-        let funcBody = hasPtrArg ? 'var ptrs = [];' : '';
-        funcBody += 'var myVM = this.vm;';
-        funcBody += 'this.setVM(myVM);';
-        for (let i = 0; i < vmArgSetters.length; i++) {
-            const setter = vmArgSetters[i];
-            if (refHelpers.isPointerType(setter.type)) {
-                funcBody += `this.argSetter${ i }(arg${ i }, ptrs);`;
-            }
-            else {
-                funcBody += `this.argSetter${ i }(arg${ i });`;
+    _getOther(callMode) {
+        let other = this._others[callMode];
+        if (!other) {
+            other = this._others[callMode] = new FastFunction(this.library, this, callMode, this._ptr);
+            if (!this.library.options.lazy) {
+                other.initialize();
             }
         }
+        return other.getFunction();
+    }
 
-        let finallyCode = '{';
-        if (this.library.synchronized) {
-            finallyCode += 'this.library._unlock();';
-            funcBody += 'this.library._lock();';
-        }
-        if (hasPtrArg) {
-            finallyCode += 'ptrs = null;';
-        }
-        finallyCode += '}';
-
-        const f = `return this.callerFunc(myVM).finally(() => ${ finallyCode });`;
-        if (this.library.queued) {
-            funcBody += `return this.library._enqueue(() => { ${ f } });`;
-        }
-        else {
-            funcBody += f;
-        }
-
-        class Ctx {
-            constructor(fn) {
-                this.library = fn.library;
-                this.setVM = dyncall.setVM;
-                this.free = dyncall.free;
-                let i = 0;
-                for (const setter of vmArgSetters) {
-                    if (refHelpers.isPointerType(setter.type)) {
-                        const specPtrDef = setter.type.callback ||
-                                setter.type.struct ||
-                                setter.type.union ||
-                                setter.type.array;
-                        if (specPtrDef) {
-                            this['argSetter' + i++] = (value, ptrs) => {
-                                const ptr = specPtrDef.makePtr(value);
-                                ptrs.push(ptr);
-                                setter.func(ptr);
-                            };
-                        }
-                        else if (refHelpers.isArrayType(setter.type)) {
-                            this['argSetter' + i++] = (value, ptrs) => {
-                                const ptr = FastFunction._makeArrayPtr(value);
-                                ptrs.push(ptr);
-                                setter.func(ptr);
-                            };
-                        }
-                        else if (refHelpers.isFunctionType(setter.type)) {
-                            this['argSetter' + i++] = (value, ptrs) => {
-                                const ptr = fn._makeCallbackPtr(value);
-                                ptrs.push(ptr);
-                                setter.func(ptr);
-                            };
-                        }
-                        else if (refHelpers.isStringType(setter.type)) {
-                            this['argSetter' + i++] = (value, ptrs) => {
-                                const ptr = fn._makeStringPtr(value);
-                                ptrs.push(ptr);
-                                setter.func(ptr);
-                            };
-                        }
-                        else {
-                            this['argSetter' + i++] = (value, ptrs) => {
-                                ptrs.push(value);
-                                setter.func(value);
-                            };
-                        }
-                    }
-                    else {
-                        this['argSetter' + i++] = setter.func;
-                    }
+    // Calls predicted to be shorter than the library's adaptiveThreshold
+    // are made inline, returning a resolved promise, the others get offloaded.
+    // Both kinds of calls update the prediction by their native execution time.
+    _makeAdaptive() {
+        const library = this.library;
+        const syncFunc = library._getSignature(this, defs.callMode.sync, true).makeFunction(this._ptr, this.resultType, this._stats);
+        const asyncSignature = library._getSignature(this, defs.callMode.async, true);
+        const asyncFunc = asyncSignature.makeFunction(this._ptr, this.resultType, this._stats, this._gate(asyncSignature));
+        const stats = new Float64Array(this._stats.buffer, this._stats.byteOffset, 4);
+        const threshold = library.options.adaptiveThreshold * 1000;
+        const queued = library.queued;
+        return function () {
+            // sync calls of queued libraries have to wait for the async ones
+            if (stats[0] <= threshold && !(queued && !library._isIdle())) {
+                stats[2]++;
+                try {
+                    return Promise.resolve(syncFunc.apply(null, arguments));
+                }
+                catch (err) {
+                    return Promise.reject(err);
                 }
-                this.callerFunc = Promise.promisify(fn._makeCallerFunc());
-                this.vm = null;
             }
-        }
-
-        const ctx = new Ctx(this);
-        const vmSize = this.library.options.vmSize;
+            stats[3]++;
+            return asyncFunc.apply(null, arguments);
+        };
+    }
 
-        let innerFunc;
-        try {
-            innerFunc = new Function(...funcArgs.concat([funcBody]));
-        }
-        catch (err) {
-            throw Error('Invalid function body: ' + funcBody);
-        }
+    _gate(signature) {
+        return signature.gated ? this.library._getGate(this) : null;
+    }
 
-        const func = function () {
-            ctx.vm = dyncall.newCallVM(vmSize);
-            return innerFunc.apply(ctx, arguments);
+    _makeStub() {
+        const self = this;
+        const stub = function () {
+            self.initialize();
+            return self._function.apply(this, arguments);
         };
-        return this._initFunction(func);
+        return this._initFunction(stub);
     }
 
     _initFunction(func) {
@@ -291,95 +216,20 @@ class FastFunction extends FunctionDefinition {
                 get: function () {
                     return self.async();
                 }
+            },
+            with: {
+                value: function (options) {
+                    return self.with(options);
+                }
+            },
+            many: {
+                value: function (argsList, options) {
+                    return self.many(argsList, options);
+                }
             }
         });
         return func;
     }
-
-    _findVMSetterFunc(type) {
-        return this.findFastcallFunc(dyncall, 'arg', type);
-    }
-
-    _makeCallerFunc() {
-        let name;
-        let isPtr = false;
-        let async = false;
-        if (this.resultType.indirection > 1) {
-            name = 'callPointer';
-            isPtr = true;
-        }
-        else {
-            name = 'call' + this.toFastcallName(this.resultType.name);
-        }
-        if (this.callMode === defs.callMode.async) {
-            name += 'Async';
-            async = true;
-        }
-
-        const func = dyncall[name];
-        a&&ert(_.isFunction(func));
-
-        if (async) {
-            if (isPtr) {
-                const resultDerefType = ref.derefType(this.resultType);
-                return (vm, callback) => {
-                    func(vm, this._ptr, (err, result) => {
-                        if (err) {
-                            return callback(err);
-                        }
-                        result.type = resultDerefType;
-                        callback(null, result);
-                    });
-                };
-            }
-
-            return (vm, callback) => func(vm, this._ptr, callback);
-        }
-
-        if (isPtr) {
-            const resultDerefType = ref.derefType(this.resultType);
-            return () => {
-                const result = func(this._ptr);
-                result.type = resultDerefType;
-                return result;
-            };
-        }
-
-        return () => func(this._ptr);
-    }
-
-    static _makeArrayPtr(value) {
-        if (value === null) {
-            return null;
-        }
-        if (value.buffer) {
-            return value.buffer;
-        }
-        assert(value instanceof Buffer, 'Argument is not a Buffer.');
-        return value;
-    }
-
-    _makeCallbackPtr(value) {
-        if (value === null) {
-            return null;
-        }
-        if (value._makePtr) {
-            return value._makePtr(this.library);
-        }
-        assert(value instanceof Buffer, 'Argument is not a Buffer.');
-        return value;
-    }
-
-    _makeStringPtr(value) {
-        if (value === null) {
-            return null;
-        }
-        if (_.isString(value)) {
-            return native.makeStringBuffer(value);
-        }
-        assert(value instanceof Buffer, 'Argument is not a Buffer.');
-        return value;
-    }
 }
 
 module.exports = FastFunction;
\ No newline at end of file
@@ -24,6 +24,7 @@ const ref = require('./ref-libs/ref');
 const util = require('util');
 const Parser = require('./Parser');
 const typeCode = require('./typeCode');
+const ArgQualifiers = require('./ArgQualifiers');
 
 class FunctionDefinition {
     constructor(library, def) {
@@ -35,11 +36,15 @@ class FunctionDefinition {
             this.resultType = def.resultType;
             this.name = def.name;
             this.args = Object.freeze(def.args);
+            this.lock = Object.freeze(def.lock);
+            this.maxConcurrency = def.maxConcurrency;
         }
         else if (def.resultType && def.name && def.args) {
             this.resultType = def.resultType;
             this.name = def.name;
             this.args = Object.freeze(def.args);
+            this.lock = def.lock || Object.freeze({ shared: false, group: null });
+            this.maxConcurrency = def.maxConcurrency || 0;
         }
         else {
             throw new TypeError(`Invalid function definition: ${ def }.`);
@@ -60,8 +65,13 @@ class FunctionDefinition {
     }
 
     toString() {
-        let args = this.args.map(arg => util.format('%s %s', getTypeName(arg.type), arg.name)).join(', ');
-        return util.format('%s %s(%s)', getTypeName(this.resultType), this.name, args);
+        let args = this.args.map(arg => {
+            const qualifiers = arg.qualifiers ? ArgQualifiers.toString(arg.qualifiers) : '';
+            return util.format('%s%s %s', qualifiers, getTypeName(arg.type), arg.name);
+        }).join(', ');
+        const qualifiers = ArgQualifiers.lockToString(this.lock) +
+            (this.maxConcurrency ? `concurrency(${ this.maxConcurrency }) ` : '');
+        return util.format('%s%s %s(%s)', qualifiers, getTypeName(this.resultType), this.name, args);
 
         function getTypeName(type) {
             if (type.function) {
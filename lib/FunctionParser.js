@@ -23,6 +23,7 @@ const ert = verify.ert;
 const ref = require('./ref-libs/ref');
 const util = require('util');
 const rex = require('./rex');
+const ArgQualifiers = require('./ArgQualifiers');
 
 class FunctionParser {
     constructor(parser) {
@@ -50,33 +51,76 @@ class FunctionParser {
         assert(_.isArray(arr), 'Function definition array expected.');
         assert(arr.length > 1, 'Function definition array is empty.');
         const resultType = this.parser._makeRef(arr[0]);
+        const lock = arr[2] ? ArgQualifiers.lockFromOptions(arr[2]) : { shared: false, group: null };
+        const maxConcurrency = arr[2] ? ArgQualifiers.concurrencyFromOptions(arr[2]) : 0;
         const args = [];
         if (_.isArray(arr[1])) {
             for (let i = 0; i < arr[1].length; i++) {
-                args.push({
-                    name: 'arg' + i,
-                    type: this.parser._makeRef(arr[1][i])
-                });
+                const spec = arr[1][i];
+                if (ArgQualifiers.isSpec(spec)) {
+                    args.push({
+                        name: 'arg' + i,
+                        type: this.parser._makeRef(spec.type),
+                        qualifiers: ArgQualifiers.fromSpec(spec)
+                    });
+                }
+                else {
+                    args.push({
+                        name: 'arg' + i,
+                        type: this.parser._makeRef(spec)
+                    });
+                }
             }
         }
-        return { resultType, name, args };
+        return { resultType, name, args, lock, maxConcurrency };
     }
 
     _parseString(def) {
-        const match = rex.matchFunction(def);
+        // the textual signature gets cached, only its types are resolved here
+        const signature = this.parser._match('signature', def, def => this._parseSignature(def));
+        const args = signature.args.map(arg => {
+            const decl = {
+                name: arg.name,
+                type: this.parser._makeRef(arg.type, true)
+            };
+            if (arg.qualifiers) {
+                decl.qualifiers = _.clone(arg.qualifiers);
+            }
+            return decl;
+        });
+        return {
+            resultType: this.parser._makeRef(signature.resultType),
+            name: signature.name,
+            args,
+            lock: _.clone(signature.lock),
+            maxConcurrency: signature.maxConcurrency
+        };
+    }
+
+    _parseSignature(def) {
+        const parsedFunc = ArgQualifiers.parseFunction(def);
+        const match = this.parser._match('function', parsedFunc.def, rex.matchFunction);
         assert(match, 'Invalid function definition format.');
-        const resultType = this.parser._makeRef(match.resultType);
         let i = 0;
-        const args = match.args.map(arg => this.parser._parseDeclaration({
-            def: arg,
-            title: 'argument',
-            defaultName: 'arg' + i++,
-            isInterface: true
-        }));
+        const args = match.args.map(arg => {
+            const parsed = ArgQualifiers.parse(arg);
+            const decl = this.parser._splitDeclaration({
+                def: parsed.def,
+                title: 'argument',
+                defaultName: 'arg' + i++
+            });
+            return {
+                name: decl.name,
+                type: decl.type,
+                qualifiers: parsed.qualifiers
+            };
+        });
         return {
-            resultType,
+            resultType: match.resultType,
             name: match.name,
-            args
+            args,
+            lock: parsedFunc.lock,
+            maxConcurrency: parsedFunc.maxConcurrency
         };
     }
 }
@@ -31,14 +31,32 @@ const FastArray = require('./FastArray');
 const verify = require('./verify');
 const a = verify.a;
 const ert = verify.ert;
-const queue = require('./queue');
 const NameFactory = require('./NameFactory');
 const Parser = require('./Parser');
+const DeclarationCache = require('./DeclarationCache');
+const StringCache = require('./StringCache');
+const CallSignature = require('./CallSignature');
+const Backpressure = require('./Backpressure');
+const CallRing = require('./CallRing');
+const Batch = require('./Batch');
+const CallPlan = require('./CallPlan');
+const packedCall = require('./packedCall');
+
+// The maps of the declarations, see _declare().
+const DECLARATIONS = ['functions', 'callbacks', 'structs', 'unions', 'arrays', 'interface'];
 
 const defaultOptions = {
     defaultCallMode: defs.callMode.sync,
     syncMode: defs.syncMode.none,
-    vmSize: 512
+    vmSize: 0,
+    lazy: false,
+    cacheDir: null,
+    loadFlags: 0,
+    stringCacheSize: 1024,
+    adaptiveThreshold: 100,
+    maxConcurrency: 0,
+    maxPending: 0,
+    backpressure: 'reject'
 };
 
 class Library {
@@ -46,17 +64,43 @@ class Library {
         this.path = path || "";
         this.options = Object.freeze(_.defaults(options, defaultOptions));
         assert(this.options.defaultCallMode === defs.callMode.sync ||
-            this.options.defaultCallMode === defs.callMode.async,
+            this.options.defaultCallMode === defs.callMode.async ||
+            this.options.defaultCallMode === defs.callMode.adaptive,
             '"options.callMode" is invalid.');
+        assert(_.isNumber(this.options.adaptiveThreshold) && this.options.adaptiveThreshold >= 0,
+            '"options.adaptiveThreshold" is invalid.');
         assert(this.options.syncMode >= defs.syncMode.none && this.options.syncMode <= defs.syncMode.queue,
             '"options.syncMode" is invalid.');
+        assert(_.isInteger(this.options.loadFlags) && this.options.loadFlags >= 0,
+            '"options.loadFlags" is invalid.');
+        assert(_.isInteger(this.options.stringCacheSize) && this.options.stringCacheSize >= 0,
+            '"options.stringCacheSize" is invalid.');
+        assert(_.isInteger(this.options.maxConcurrency) && this.options.maxConcurrency >= 0,
+            '"options.maxConcurrency" is invalid.');
+        assert(_.isInteger(this.options.maxPending) && this.options.maxPending >= 0,
+            '"options.maxPending" is invalid.');
+        assert(this.options.backpressure === 'reject' || this.options.backpressure === 'wait',
+            '"options.backpressure" is invalid.');
         this._pLib = null;
         this._initialized = false;
+        this._initializing = null;
         this._released = false;
+        this._resolving = 0; // async symbol lookups using _pLib
         this._loop = null;
-        this._mutex = null;
-        this._queue = null;
+        this._locks = null;
+        this._executor = null;
+        this._gate = null;
+        this._functionGates = {};
+        this._callRings = [];
+        this._backpressure = this.options.maxPending ?
+            new Backpressure(this, this.options.maxPending, this.options.backpressure) :
+            null;
+        this._declaring = null;
+        this._signatures = {};
         this._nameFactory = new NameFactory();
+        this._cache = this.options.cacheDir ? new DeclarationCache(this.options.cacheDir, this.path) : null;
+        this.stringCache = new StringCache(this.options.stringCacheSize);
+        this.cancellations = { aborted: 0, timedOut: 0, tooLate: 0 };
         this.functions = {};
         this.callbacks = {};
         this.structs = {};
@@ -78,28 +122,124 @@ class Library {
         if (this._initialized) {
             return;
         }
-        this._pLib = native.dynload.loadLibrary(this.path);
+        this._setup(native.dynload.loadLibrary(this.path, this.options.loadFlags));
+        return this;
+    }
+
+    initializeAsync(options) {
+        const prelink = Boolean(options && options.prelink);
+        return Promise.try(() => {
+            assert(!this._released, `Library "${ this.path }" has already been released.`);
+            if (this._initialized) {
+                return prelink ? this.prelinkAsync() : this;
+            }
+            if (this._initializing) {
+                return this._initializing.then(() => prelink ? this.prelinkAsync() : this);
+            }
+            const funcs = prelink ? this._getUnlinkedFunctions() : [];
+            this._initializing = new Promise((resolve, reject) => {
+                native.dynload.loadLibraryAsync(this.path, this.options.loadFlags, funcs.map(func => func.name), (err, pLib, ptrs) => {
+                    if (err) {
+                        return reject(err);
+                    }
+                    resolve({ pLib, ptrs });
+                });
+            })
+            .then(loaded => {
+                if (this._released) {
+                    native.dynload.freeLibrary(loaded.pLib);
+                    assert(false, `Library "${ this.path }" has been released.`);
+                }
+                if (this._initialized) {
+                    // Got initialized synchronously in the meantime,
+                    // dropping our reference of the library.
+                    native.dynload.freeLibrary(loaded.pLib);
+                }
+                else {
+                    this._setup(loaded.pLib);
+                }
+                this._assertLinked(this._link(funcs, loaded.ptrs));
+                return this;
+            })
+            .finally(() => {
+                this._initializing = null;
+            });
+            return this._initializing;
+        });
+    }
+
+    _setup(pLib) {
+        a&&ert(pLib instanceof Buffer);
+        this._pLib = pLib;
         this._loop = native.callback.newLoop();
         if (this.options.syncMode === defs.syncMode.lock) {
-            this._mutex = native.mutex.newMutex();
-            a&&ert(this._mutex instanceof Buffer);
+            this._locks = {};
+        }
+        else if (this.options.syncMode === defs.syncMode.queue) {
+            this._executor = native.executor.newExecutor();
+            a&&ert(this._executor instanceof Buffer);
+        }
+        if (this.options.maxConcurrency) {
+            this._gate = native.gate.newGate(this.options.maxConcurrency);
         }
         this._initialized = true;
-        return this;
+    }
+
+    _initializeUnlessLazy() {
+        // In lazy mode loading the library is deferred to the first function call,
+        // so declarations can be made before initializeAsync().
+        if (!this.options.lazy) {
+            this.initialize();
+        }
     }
 
     release() {
         if (!this._initialized) {
+            if (this._initializing) {
+                // the loaded library gets freed by initializeAsync()
+                this._released = true;
+            }
             return;
         }
         if (this._released) {
             return;
         }
-        for (const func of _.values(this.functions)) {
-            func.release();
+        for (const ring of this._callRings) {
+            ring.release();
+        }
+        this._callRings = [];
+        if (this._backpressure) {
+            // before the calls in progress get aborted, and would let them in
+            this._backpressure.close(new Error(`Library "${ this.path }" has been released.`));
+        }
+        // fails the calls waiting for admission, before they get dispatched
+        for (const gate of _.values(this._functionGates)) {
+            native.gate.close(gate);
+        }
+        if (this._gate) {
+            native.gate.close(this._gate);
+        }
+        for (const lock of _.values(this._locks)) {
+            native.lock.close(lock);
         }
+        if (this._executor) {
+            // waits for the calls in progress
+            native.executor.freeExecutor(this._executor);
+            this._executor = null;
+        }
+        for (const signature of _.values(this._signatures)) {
+            signature.release();
+        }
+        this.stringCache.clear();
+        // freed by the GC when their calls are done
+        this._gate = null;
+        this._functionGates = {};
+        this._locks = {};
         native.callback.freeLoop(this._loop);
-        native.dynload.freeLibrary(this._pLib);
+        if (!this._resolving) {
+            // otherwise it's freed when the lookups are done, see prelinkAsync()
+            native.dynload.freeLibrary(this._pLib);
+        }
         this._released = true;
         return this;
     }
@@ -111,22 +251,112 @@ class Library {
         return Boolean(native.dynload.findSymbol(this._pLib, name));
     }
 
+    getSymbol(name) {
+        assert(_.isString(name), 'Argument is not a string.');
+
+        this.initialize();
+        return native.dynload.findSymbol(this._pLib, name);
+    }
+
+    listSymbols() {
+        return native.dynload.listSymbols(this.path);
+    }
+
+    prelink() {
+        this.initialize();
+        const funcs = this._getUnlinkedFunctions();
+        if (funcs.length) {
+            const ptrs = native.dynload.resolveAll(this._pLib, funcs.map(func => func.name));
+            this._assertLinked(this._link(funcs, ptrs));
+        }
+        return this;
+    }
+
+    prelinkAsync() {
+        return Promise.try(() => {
+            this.initialize();
+            const funcs = this._getUnlinkedFunctions();
+            if (!funcs.length) {
+                return this;
+            }
+            this._resolving++;
+            return new Promise((resolve, reject) => {
+                native.dynload.resolveAllAsync(this._pLib, funcs.map(func => func.name), (err, ptrs) => {
+                    if (!--this._resolving && this._released) {
+                        native.dynload.freeLibrary(this._pLib);
+                    }
+                    if (err) {
+                        return reject(err);
+                    }
+                    resolve(ptrs);
+                });
+            })
+            .then(ptrs => {
+                assert(!this._released, `Library "${ this.path }" has been released.`);
+                this._assertLinked(this._link(funcs, ptrs));
+                return this;
+            });
+        });
+    }
+
     declare(str) {
-        return new Parser(this).parseMultiline(str, null);
+        return this._declare(str, null);
     }
 
     declareSync(str) {
-        return new Parser(this).parseMultiline(str, defs.callMode.sync);
+        return this._declare(str, defs.callMode.sync);
     }
 
     declareAsync(str) {
-        return new Parser(this).parseMultiline(str, defs.callMode.async);
+        return this._declare(str, defs.callMode.async);
+    }
+
+    declareAdaptive(str) {
+        return this._declare(str, defs.callMode.adaptive);
+    }
+
+    _declare(str, callMode) {
+        // A declaration gets added as a whole or not at all: its functions
+        // get their symbols resolved in one go (see _addFunction()), and
+        // everything it has added is removed if any part of it fails.
+        const snapshot = this._snapshotDeclarations();
+        const funcs = this._declaring = [];
+        try {
+            new Parser(this).parseMultiline(str, callMode);
+            if (funcs.length) {
+                this._initializeFunctions(funcs);
+            }
+        }
+        catch (err) {
+            this._rollbackDeclarations(snapshot);
+            throw err;
+        }
+        finally {
+            this._declaring = null;
+        }
+        if (this._cache) {
+            this._cache.save();
+        }
+        return this;
+    }
+
+    _snapshotDeclarations() {
+        return DECLARATIONS.map(name => new Set(_.keys(this[name])));
+    }
+
+    _rollbackDeclarations(snapshot) {
+        DECLARATIONS.forEach((name, i) => {
+            for (const key of _.keys(this[name])) {
+                if (!snapshot[i].has(key)) {
+                    delete this[name][key];
+                }
+            }
+        });
     }
 
     function(def) {
-        return this.options.defaultCallMode === defs.callMode.sync ?
-            this.syncFunction(def) :
-            this.asyncFunction(def);
+        this._addFunction(new FastFunction(this, def, this.options.defaultCallMode));
+        return this;
     }
 
     syncFunction(def) {
@@ -139,6 +369,11 @@ class Library {
         return this;
     }
 
+    adaptiveFunction(def) {
+        this._addFunction(new FastFunction(this, def, defs.callMode.adaptive));
+        return this;
+    }
+
     callback(def) {
         this._addCallback(new FastCallback(this, def));
         return this;
@@ -166,15 +401,65 @@ class Library {
 
     _addFunction(func) {
         assert(!this.functions[func.name], `Function ${ func.name } already declared.`);
-        this.initialize();
-        func.initialize();
+        this._initializeUnlessLazy();
+        if (this._declaring && !this.options.lazy) {
+            this.functions[func.name] = func;
+            this._declaring.push(func);
+            return;
+        }
+        if (!this.options.lazy) {
+            func.initialize();
+        }
         this.functions[func.name] = func;
         this.interface[func.name] = func.getFunction();
     }
 
+    _getSignature(func, callMode, measured) {
+        const key = CallSignature.keyOf(func, callMode, measured);
+        let signature = this._signatures[key];
+        if (!signature) {
+            signature = this._signatures[key] = new CallSignature(this, func, callMode, measured);
+        }
+        return signature;
+    }
+
+    _initializeFunctions(funcs) {
+        const unlinked = funcs.filter(func => !func._ptr);
+        if (unlinked.length) {
+            const ptrs = native.dynload.resolveAll(this._pLib, unlinked.map(func => func.name));
+            this._assertLinked(this._link(unlinked, ptrs));
+        }
+        for (const func of funcs) {
+            func.initialize();
+            this.interface[func.name] = func.getFunction();
+        }
+    }
+
+    _getUnlinkedFunctions() {
+        return _.values(this.functions).filter(func => !func._ptr);
+    }
+
+    _link(funcs, ptrs) {
+        a&&ert(funcs.length === ptrs.length);
+        const missing = [];
+        for (let i = 0; i < funcs.length; i++) {
+            if (ptrs[i]) {
+                funcs[i].link(ptrs[i]);
+            }
+            else {
+                missing.push(funcs[i].name);
+            }
+        }
+        return missing;
+    }
+
+    _assertLinked(missing) {
+        assert(!missing.length, `Symbols not found in library "${ this.path }": ${ missing.join(', ') }.`);
+    }
+
     _addCallback(cb) {
         assert(!this.callbacks[cb.name], `Callback ${ cb.name } already declared.`);
-        this.initialize();
+        this._initializeUnlessLazy();
         cb.initialize();
         this.callbacks[cb.name] = cb;
         this.interface[cb.name] = cb.getFactory();
@@ -182,39 +467,127 @@ class Library {
 
     _addStruct(struct) {
         assert(!this.structs[struct.name], `Union ${ struct.name } already declared.`);
-        this.initialize();
+        this._initializeUnlessLazy();
         this.structs[struct.name] = struct;
         this.interface[struct.name] = struct.getFactory();
     }
 
     _addUnion(union) {
         assert(!this.unions[union.name], `Union ${ union.name } already declared.`);
-        this.initialize();
+        this._initializeUnlessLazy();
         this.unions[union.name] = union;
         this.interface[union.name] = union.getFactory();
     }
 
     _addArray(array) {
         assert(!this.arrays[array.name], `Array ${ array.name } already declared.`);
-        this.initialize();
+        this._initializeUnlessLazy();
         this.arrays[array.name] = array;
         this.interface[array.name] = array.getFactory();
     }
 
-    _lock() {
-        native.mutex.lock(this._mutex);
+    lockState(group) {
+        assert(this.synchronized, `Library "${ this.path }" is not synchronized.`);
+        this.initialize();
+        return native.lock.state(this._getLock(group));
     }
 
-    _unlock() {
-        native.mutex.unlock(this._mutex);
+    // submitBatch([{ fn, args }, ...]): makes the calls asynchronously
+    // by a single native call, returns a promise of a Float64Array of their
+    // results. fn is a function's name, metadata or interface function.
+    submitBatch(calls, options) {
+        assert(_.isArray(calls), 'Argument "calls" is not an array.');
+        this.initialize();
+        const funcs = calls.map(call => packedCall.findFunction(this, call.fn));
+        return Batch.submit(this, calls.length, i => funcs[i], i => calls[i].args, options);
     }
 
-    _assertQueueEmpty() {
-        assert(!queue.length, 'Calling functions synchronously is forbidden while there are asynchronous functions enqueued.');
+    // Builds a chain of dependent async calls, that runs on a worker thread
+    // as a whole, see CallPlan. Returns a function of the plan's inputs,
+    // returning a promise of its output.
+    callPlan(build) {
+        assert(_.isFunction(build), 'Argument "build" is not a function.');
+        this.initialize();
+        const plan = new CallPlan(this, build);
+        return function () {
+            return plan.run(_.toArray(arguments));
+        };
     }
 
-    _enqueue(f) {
-        return queue.next(f);
+    // Records a sequence of sync calls once (see CallPlan), returns a
+    // function of its inputs running them by a single native call, its
+    // scratch slots are accessible by the scratch Float64Array property.
+    callProgram(build) {
+        assert(_.isFunction(build), 'Argument "build" is not a function.');
+        this.initialize();
+        const plan = new CallPlan(this, build);
+        const program = function () {
+            return plan.runSync(_.toArray(arguments));
+        };
+        program.scratch = plan.scratch;
+        return program;
+    }
+
+    // Creates a submission/completion ring for making lots of async calls
+    // without a promise per call, see CallRing.
+    callRing(options) {
+        assert(this.options.syncMode === defs.syncMode.none, 'Call rings are not supported by synchronized libraries.');
+        this.initialize();
+        const ring = new CallRing(this, options);
+        this._callRings.push(ring);
+        return ring;
+    }
+
+    // { running, queued } async calls of the library, or of a function
+    // having its own concurrency limit.
+    gateState(functionName) {
+        this.initialize();
+        const gate = functionName ? this._functionGates[functionName] : this._gate;
+        return gate ? native.gate.state(gate) : { running: 0, queued: 0 };
+    }
+
+    // Backpressure of the library (options.maxPending): the numbers of pending,
+    // waiting and rejected async calls.
+    get backpressure() {
+        const backpressure = this._backpressure;
+        if (!backpressure) {
+            return null;
+        }
+        return {
+            pending: backpressure.pending,
+            waiting: backpressure.waiting,
+            rejected: backpressure.rejected
+        };
+    }
+
+    _getGate(func) {
+        a&&ert(this._initialized);
+        if (!func.maxConcurrency) {
+            return this._gate;
+        }
+        let gate = this._functionGates[func.name];
+        if (!gate) {
+            gate = this._functionGates[func.name] = native.gate.newGate(func.maxConcurrency, this._gate);
+        }
+        return gate;
+    }
+
+    _getLock(group) {
+        a&&ert(this._locks);
+        group = group || '';
+        let lock = this._locks[group];
+        if (!lock) {
+            lock = this._locks[group] = native.lock.newLock();
+        }
+        return lock;
+    }
+
+    _isIdle() {
+        return native.executor.isIdle(this._executor);
+    }
+
+    _assertQueueEmpty() {
+        assert(this._isIdle(), 'Calling functions synchronously is forbidden while there are asynchronous functions enqueued.');
     }
 
     makeName(prefix) {
@@ -225,6 +598,14 @@ class Library {
         return defs.callMode;
     }
 
+    static get priority() {
+        return defs.priority;
+    }
+
+    static get loadFlags() {
+        return defs.loadFlags;
+    }
+
     static get syncMode() {
         return defs.syncMode;
     }
@@ -25,6 +25,7 @@ const util = require('util');
 const rex = require('./rex');
 const splitter = require('./splitter');
 const defs = require('./defs');
+const ArgQualifiers = require('./ArgQualifiers');
 
 class MultilineParser {
     constructor(parser) {
@@ -36,9 +37,10 @@ class MultilineParser {
     parse(str, callMode) {
         assert(_.isString(str), 'Argument is not a string.');
 
-        const lib = this.parser.library;
-        for (const part of splitter.split(str)) {
-            const match = rex.matchFunction(part);
+        const parser = this.parser;
+        const lib = parser.library;
+        for (const part of parser._match('split', str, splitter.split)) {
+            const match = parser._match('function', ArgQualifiers.parseFunction(part).def, rex.matchFunction);
             if (match) {
                 if (match.isCallback) {
                     lib.callback(part);
@@ -49,17 +51,20 @@ class MultilineParser {
                 else if (callMode === defs.callMode.async) {
                     lib.asyncFunction(part);
                 }
+                else if (callMode === defs.callMode.adaptive) {
+                    lib.adaptiveFunction(part);
+                }
                 else {
                     lib.function(part);
                 }
             }
-            else if (rex.matchArrayDeclaration(part)) {
+            else if (parser._match('array', part, rex.matchArrayDeclaration)) {
                 lib.array(part);
             }
-            else if (rex.matchFields('struct', part)) {
+            else if (parser._match('struct', part, str => rex.matchFields('struct', str))) {
                 lib.struct(part);
             }
-            else if (rex.matchFields('union', part)) {
+            else if (parser._match('union', part, str => rex.matchFields('union', str))) {
                 lib.union(part);
             }
             else {
@@ -51,7 +51,37 @@ class Parser {
         return this.multilineParser.parse(str, callMode);
     }
 
+    _match(kind, str, matchFunc) {
+        const cache = this.library._cache;
+        if (cache) {
+            return cache.match(kind, str, matchFunc);
+        }
+        return matchFunc(str);
+    }
+
+    // Layouts of the struct and union declarations, see RefTypeParser.
+    _lookupLayout(def) {
+        const cache = this.library._cache;
+        return cache ? cache.lookup('layout', def) : undefined;
+    }
+
+    _storeLayout(def, layout) {
+        const cache = this.library._cache;
+        if (cache) {
+            cache.store('layout', def, layout);
+        }
+    }
+
     _parseDeclaration(args) {
+        const decl = this._splitDeclaration(args);
+        return {
+            name: decl.name,
+            type: this._makeRef(decl.type, args.isInterface)
+        };
+    }
+
+    // The textual part of _parseDeclaration(): the name, and the type's name.
+    _splitDeclaration(args) {
         let def = args.def;
         const title = args.title;
         def = def.trim();
@@ -75,7 +105,7 @@ class Parser {
         }
         return {
             name: part2 || args.defaultName,
-            type: this._makeRef(part1, args.isInterface)
+            type: part1
         };
     }
 
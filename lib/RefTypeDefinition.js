@@ -23,6 +23,7 @@ const ert = verify.ert;
 const ref = require('./ref-libs/ref');
 const Parser = require('./Parser');
 const rex = require('./rex');
+const refHelpers = require('./refHelpers');
 
 class RefTypeDefinition {
     constructor(library, propertyName, def) {
@@ -60,7 +61,7 @@ class RefTypeDefinition {
     makePtr(value) {
         const propName = this.propertyName;
         if (value) {
-            if (value instanceof Buffer) {
+            if (refHelpers.isPointerLike(value)) {
                 return value;
             }
 
@@ -74,14 +74,22 @@ class RefTypeParser {
 
     _parseString(def, typeHint) {
         const factoryType = RefTypeParser._getFactoryType(typeHint);
+        let created;
         let parsed;
         if (typeHint === 'array') {
             parsed = this._parseArray(def);
+            created = this._makeType(factoryType, parsed.defBody, parsed.length);
         }
         else {
+            // a cached layout is taken if the field types still match it
             parsed = this._parseFields(def, typeHint);
+            const layout = this.parser._lookupLayout(def);
+            created = this._makeType(factoryType, parsed.defBody, { layout });
+            if (!layout || !created.type.layoutApplied) {
+                this.parser._storeLayout(def, created.type.getLayout());
+            }
         }
-        const { type, body } = this._makeType(factoryType, parsed.defBody, parsed.length);
+        const { type, body } = created;
         return {
             name: parsed.name,
             factoryType,
@@ -118,28 +126,41 @@ class RefTypeParser {
     }
 
     _parseFields(def, keyword) {
-        const match = rex.matchFields(keyword, def);
-        assert(match, `Invalid ${ keyword } definition format.`);
+        // the names and type names of the fields get cached,
+        // only the types are resolved here
+        const fields = this.parser._match(`${ keyword }Fields`, def, def => this._splitFields(def, keyword));
         const defBody = {};
+        for (const field of fields.fields) {
+            defBody[field[0]] = this.parser._makeRef(field[1], false);
+        }
+        return {
+            name: fields.name,
+            defBody
+        };
+    }
+
+    _splitFields(def, keyword) {
+        const match = this.parser._match(keyword, def, str => rex.matchFields(keyword, str));
+        assert(match, `Invalid ${ keyword } definition format.`);
+        const fields = [];
         for (const part of match.parts) {
             const fieldDecl = part.trim();
             if (fieldDecl) {
-                const decl = this.parser._parseDeclaration({
+                const decl = this.parser._splitDeclaration({
                     def: part,
-                    title: 'field',
-                    isInterface: false
+                    title: 'field'
                 });
-                defBody[decl.name] = decl.type;
+                fields.push([decl.name, decl.type]);
             }
         }
         return {
             name: match.name,
-            defBody
+            fields
         };
     }
 
     _parseArray(def) {
-        const match = rex.matchArrayDeclaration(def);
+        const match = this.parser._match('array', def, rex.matchArrayDeclaration);
         assert(match, `Invalid array definition format.`);
 
         return match;
@@ -0,0 +1,67 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+'use strict';
+const _ = require('lodash');
+const assert = require('assert');
+const native = require('./native');
+
+// Encoded C strings of the interned arguments of a library's functions, by
+// their JS string values (V8 hashes internalized strings once, so lookups
+// of literal and property name keys are cheap). A Map keeps the insertion
+// order, so moving hits to the end gives the least recently used entry
+// at the front. Buffers of evicted entries are freed by the GC, after the
+// calls that got them (async ones keep their argument pointers) are done.
+class StringCache {
+    constructor(capacity) {
+        assert(_.isInteger(capacity) && capacity >= 0, 'Argument "capacity" is not a non-negative integer.');
+
+        this.capacity = capacity;
+        this.hits = 0;
+        this.misses = 0;
+        this._entries = new Map();
+    }
+
+    get size() {
+        return this._entries.size;
+    }
+
+    get(str) {
+        let buffer = this._entries.get(str);
+        if (buffer !== undefined) {
+            this.hits++;
+            this._entries.delete(str);
+            this._entries.set(str, buffer);
+            return buffer;
+        }
+        this.misses++;
+        buffer = native.makeStringBuffer(str);
+        if (this.capacity) {
+            if (this._entries.size >= this.capacity) {
+                this._entries.delete(this._entries.keys().next().value);
+            }
+            this._entries.set(str, buffer);
+        }
+        return buffer;
+    }
+
+    clear() {
+        this._entries.clear();
+    }
+}
+
+module.exports = StringCache;
@@ -18,11 +18,25 @@ limitations under the License.
 
 exports.callMode = {
     sync: 1,
-    async: 2
+    async: 2,
+    adaptive: 3
 };
 
 exports.syncMode = {
     none: 0,
     lock: 1,
     queue: 2
-};
\ No newline at end of file
+};
+
+exports.loadFlags = {
+    lazy: 1,
+    now: 2,
+    global: 4,
+    local: 8,
+    deepBind: 16
+};
+exports.priority = {
+    interactive: 0,
+    default: 1,
+    background: 2
+};
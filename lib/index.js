@@ -24,8 +24,12 @@ if (!es5Support.fallbackToES5(exports, 'lib')) {
     exports.ArrayType = require('./ref-libs/array');
     exports.scope = require('./scope');
     exports.Disposable = require('./Disposable');
+    exports.Arena = require('./Arena');
     exports.Library = require('./Library');
     exports.ffi = require('./ffi');
+    exports.CancelledError = require('./CallOptions').CancelledError;
+    exports.QueueFullError = require('./CallOptions').QueueFullError;
+    exports.CallPlanError = require('./CallPlan').Error;
 
     var native = require('./native');
     exports.makeStringBuffer = native.makeStringBuffer;
@@ -0,0 +1,125 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const _ = require('lodash');
+const assert = require('assert');
+const ref = require('./ref-libs/ref');
+const refHelpers = require('./refHelpers');
+const ArgQualifiers = require('./ArgQualifiers');
+
+// Calls packed into memory shared with the native side (see src/packedcall.h),
+// used by call rings and batches: 64 bytes per call, uint32 function index,
+// uint32 (unused), double args[7]. Arguments and results are passed as
+// doubles, typed by the dyncall type codes of the function.
+const CALL_SIZE = 64;
+const MAX_ARGS = 7;
+const SUPPORTED_CODES = 'BcCsSiIjJlLfdp';
+
+exports.CALL_SIZE = CALL_SIZE;
+exports.MAX_ARGS = MAX_ARGS;
+
+// Returns the [ptr, argCodes, resultCode] descriptor of a function,
+// that's understood by the native side.
+exports.describe = function (func) {
+    assert(!ArgQualifiers.isQualified(func), `Function "${ func.name }" has qualified arguments.`);
+    assert(func.args.length <= MAX_ARGS, `Function "${ func.name }" has more than ${ MAX_ARGS } arguments.`);
+    const argCodes = func.args.map(arg => arg.type.code).join('');
+    const resultCode = func.resultType.code;
+    assert(_.every(argCodes, code => _.includes(SUPPORTED_CODES, code)) &&
+        (resultCode === 'v' || _.includes(SUPPORTED_CODES, resultCode)),
+        `Function "${ func.name }" has arguments or result of unsupported types.`);
+    func.initialize();
+    return [func._ptr, argCodes, resultCode];
+};
+
+// Resolves a function of the library, given by its name, metadata
+// or interface function.
+exports.findFunction = function (library, func) {
+    if (_.isString(func)) {
+        const result = library.functions[func];
+        assert(result, `Function "${ func }" not found.`);
+        return result;
+    }
+    if (_.isFunction(func)) {
+        func = func.function;
+    }
+    assert(func && func.library === library, 'Argument is not a function of the library.');
+    return func;
+};
+
+// [min, end) ranges of the integer type codes, values are truncated
+// toward zero by the native side, so these are the ones it could convert.
+const RANGES = {
+    c: [-0x80, 0x80],
+    C: [0, 0x100],
+    s: [-0x8000, 0x8000],
+    S: [0, 0x10000],
+    i: [-0x80000000, 0x80000000],
+    I: [0, 0x100000000],
+    j: ref.sizeof.long === 8 ? [-0x8000000000000000, 0x8000000000000000] : [-0x80000000, 0x80000000],
+    J: ref.sizeof.long === 8 ? [0, 0x10000000000000000] : [0, 0x100000000],
+    l: [-0x8000000000000000, 0x8000000000000000],
+    L: [0, 0x10000000000000000],
+    p: [0, 0x10000000000000000]
+};
+
+// Converts an argument to be passed as the dyncall type codes of codes
+// (an argument could be passed to more functions by call plans).
+// Pointers are passed as addresses, null, Buffers, TypedArrays, DataViews
+// and array buffers, by the same rules as the arguments of calls (no copies
+// are made, callers must keep them alive until the call completes).
+// Throws a TypeError for other values, NaN and values out of the range of
+// an integer type, like the Buffer writers do, converting those by
+// the native side is undefined behavior.
+exports.toNumber = function (value, codes) {
+    if (typeof value !== 'number') {
+        value = toAddress(value);
+    }
+    for (let i = 0; i < codes.length; i++) {
+        const range = RANGES[codes[i]];
+        if (range && !(value >= range[0] && value < range[1])) {
+            throw new TypeError(`Value ${ value } is out of the range of type code "${ codes[i] }".`);
+        }
+    }
+    return value;
+};
+
+// Whether value is referenced by its address when passed, so it should be
+// kept alive while the call is in progress.
+exports.isReferenced = function (value) {
+    return value instanceof Buffer || refHelpers.isPointerLike(value);
+};
+
+function toAddress(value) {
+    if (value === null) {
+        return 0;
+    }
+    if (typeof value === 'boolean') {
+        return value ? 1 : 0;
+    }
+    if (value instanceof Buffer) {
+        return ref.address(value);
+    }
+    if (ArrayBuffer.isView(value)) {
+        // a Buffer over the same memory, offset by the view
+        return ref.address(new Buffer(value.buffer)) + value.byteOffset;
+    }
+    if (refHelpers.isPointerLike(value)) {
+        return ref.address(new Buffer(value));
+    }
+    throw new TypeError(`Value ${ value } is neither a number nor a pointer.`);
+}
@@ -7,6 +7,7 @@ var _ref = require('./ref')
 var assert = require('assert')
 var debug = require('debug')('ref:array')
 var ArrayIndex = require('./ArrayIndex')
+var primitives = require('./primitives')
 var isArray = Array.isArray
 
 /**
@@ -30,6 +31,11 @@ module.exports = function Array (_type, _length) {
     }
     debug('creating new array instance')
     ArrayIndex.call(this)
+    // the cache of typedArray, hidden from enumeration and deepEqual()
+    Object.defineProperties(this, {
+      _view: { value: null, writable: true, enumerable: false, configurable: true },
+      _viewBuffer: { value: null, writable: true, enumerable: false, configurable: true }
+    })
     var item_size = ArrayType.BYTES_PER_ELEMENT
     if (0 === arguments.length) {
       // new IntArray()
@@ -61,8 +67,13 @@ module.exports = function Array (_type, _length) {
       }
       this.length = len
       this.buffer = new Buffer(len * item_size)
-      for (var i = 0; i < len; i++) {
-        this[ArrayIndex.set](i, data[i])
+      var view = ArrayType.TypedArray && !ArrayType.isChar ? this.typedArray : null
+      if (view && primitives.fitsAll(ArrayType.primitive, data)) {
+        view.set(data.length > len ? data.slice(0, len) : data)
+      } else {
+        for (var i = 0; i < len; i++) {
+          this[ArrayIndex.set](i, data[i])
+        }
       }
     } else if (Buffer.isBuffer(data)) {
       // new IntArray(Buffer(8))
@@ -116,6 +127,18 @@ module.exports = function Array (_type, _length) {
       enumerable: true,
       writable: true,
       configurable: true
+    },
+    // aliasing TypedArray view of number arrays
+    typedArray: {
+      get: typedArray,
+      enumerable: false,
+      configurable: true
+    },
+    toArray: {
+      value: toArray,
+      enumerable: false,
+      writable: true,
+      configurable: true
     }
   })
 
@@ -134,6 +157,12 @@ module.exports = function Array (_type, _length) {
   ArrayType.BYTES_PER_ELEMENT = type.indirection == 1 ? type.size : _ref.sizeof.pointer
   assert(ArrayType.BYTES_PER_ELEMENT > 0)
 
+  // number arrays get accessed through a TypedArray view when possible
+  var info = primitives.find(type)
+  ArrayType.primitive = info
+  ArrayType.TypedArray = info ? info.TypedArray : null
+  ArrayType.isChar = info ? info.isChar : false
+
   // the ref "type" interface
   if (fixedLength > 0) {
     // this "type" is probably going in a ref-struct or being used manually
@@ -179,7 +208,12 @@ function set (buffer, offset, value) {
   debug('Array "type" setter for buffer at offset', buffer, offset, value)
   var array = this.get(buffer, offset)
   var isInstance = value instanceof this
-  if (isInstance) {
+  var view = this.TypedArray ? array.typedArray : null
+  if (view && isInstance && value.typedArray) {
+    view.set(value.typedArray.subarray(0, value.length))
+  } else if (view && isArray(value) && !this.isChar && primitives.fitsAll(this.primitive, value)) {
+    view.set(value)
+  } else if (isInstance) {
     for (var i = 0; i < value.length; i++) {
       array[ArrayIndex.set](i, value[ArrayIndex.get](i));
     }
@@ -242,11 +276,48 @@ function ref () {
   return r
 }
 
+/**
+ * Returns a TypedArray aliasing the backing buffer, or `null` if the element
+ * type is not a number type, or the buffer is not aligned for the view.
+ * The view is cached until `buffer` gets replaced.
+ */
+
+function typedArray () {
+  var buffer = this.buffer
+  if (this._viewBuffer === buffer) {
+    return this._view
+  }
+  var TypedArray = this.constructor.TypedArray
+  var view = null
+  if (TypedArray && buffer.length && buffer.byteOffset % TypedArray.BYTES_PER_ELEMENT === 0) {
+    view = new TypedArray(buffer.buffer, buffer.byteOffset, buffer.length / TypedArray.BYTES_PER_ELEMENT | 0)
+  }
+  this._view = view
+  this._viewBuffer = buffer
+  return view
+}
+
+/**
+ * Returns the elements in a JS Array.
+ */
+
+function toArray () {
+  var view = this.typedArray
+  if (view && view.length >= this.length) {
+    return Array.prototype.slice.call(view, 0, this.length)
+  }
+  return ArrayIndex.prototype.toArray.call(this)
+}
+
 /**
  * The "getter" implementation for the "array-index" interface.
  */
 
 function getter (index) {
+  var view = this._viewBuffer === this.buffer ? this._view : this.typedArray
+  if (view && index >= 0 && index < view.length) {
+    return view[index]
+  }
   debug('getting array[%d]', index)
   var size = this.constructor.BYTES_PER_ELEMENT
   var baseType = this.constructor.type
@@ -266,6 +337,14 @@ function getter (index) {
  */
 
 function setter (index, value) {
+  if (typeof index !== 'number') {
+    return bulkSetter.call(this, index, value)
+  }
+  var view = this._viewBuffer === this.buffer ? this._view : this.typedArray
+  if (view && index >= 0 && index < view.length && primitives.fits(this.constructor.primitive, value)) {
+    view[index] = value
+    return value
+  }
   debug('setting array[%d]', index)
   var size = this.constructor.BYTES_PER_ELEMENT
   var baseType = this.constructor.type
@@ -282,6 +361,28 @@ function setter (index, value) {
   return value
 }
 
+/**
+ * `set(arrayLike[, offset])`: copies the elements of an Array, TypedArray or
+ * array instance starting at _offset_, like `TypedArray.prototype.set()`.
+ */
+
+function bulkSetter (values, offset) {
+  offset = offset | 0
+  if (values instanceof ArrayIndex) {
+    values = values.typedArray ? values.typedArray.subarray(0, values.length) : values.toArray()
+  }
+  var view = this.typedArray
+  if (view && offset + values.length <= view.length && !this.constructor.isChar &&
+      primitives.fitsAll(this.constructor.primitive, values)) {
+    view.set(values, offset)
+  } else {
+    for (var i = 0; i < values.length; i++) {
+      this[ArrayIndex.set](offset + i, values[i])
+    }
+  }
+  return values
+}
+
 function lengthChanged (newLength) {
   if (this.buffer && !_ref.isNull(this.buffer) && this.buffer.length < newLength) {
     debug('reinterpreting buffer from %d to %d', this.buffer.length, newLength)
@@ -0,0 +1,129 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const assert = require('assert');
+const ref = require('./ref');
+const primitives = require('./primitives');
+const marshal = require('./marshal');
+const native = require('../native');
+
+// A single field of every record of a struct array. Number fields are
+// read through a TypedArray over the whole array stepping by the struct's
+// size, when the stride and the address are multiples of the field's size,
+// other fields by ref.get() and ref.set() at strided offsets.
+class Column {
+    constructor(StructType, name, buffer, byteOffset, length) {
+        const field = StructType.fields[name];
+        this.name = name;
+        this.type = field.type;
+        this.length = length;
+        this.buffer = buffer;
+        this.byteOffset = byteOffset + field.offset;
+        this.stride = StructType.size;
+        this.itemSize = field.type.indirection > 1 ? ref.sizeof.pointer : field.type.size;
+        this.view = null;
+        this.step = 0;
+        this._info = primitives.find(field.type);
+
+        const info = this._info;
+        const address = buffer.byteOffset + this.byteOffset;
+        if (info && info.TypedArray && length > 0 &&
+            this.stride % info.size === 0 &&
+            address % info.size === 0) {
+            this.step = this.stride / info.size;
+            this.view = new info.TypedArray(buffer.buffer, address, (length - 1) * this.step + 1);
+        }
+    }
+
+    get(index) {
+        this._checkIndex(index);
+        if (this.view) {
+            return this.view[index * this.step];
+        }
+        const offset = this.byteOffset + index * this.stride;
+        if (this._info) {
+            const value = this.buffer[this._info.read](offset);
+            return this._info.isBool ? Boolean(value) : value;
+        }
+        return ref.get(this.buffer, offset, this.type);
+    }
+
+    // Values the TypedArray would wrap around are written by ref.set(),
+    // so those throw like by the field setters.
+    set(index, value) {
+        this._checkIndex(index);
+        if (this.view && !this._info.isChar && primitives.fits(this._info, value)) {
+            this.view[index * this.step] = value;
+            return;
+        }
+        ref.set(this.buffer, this.byteOffset + index * this.stride, value, this.type);
+    }
+
+    _checkIndex(index) {
+        if (!(Number.isInteger(index) && index >= 0 && index < this.length)) {
+            throw new RangeError(`Index ${ index } is out of the bounds of column "${ this.name }".`);
+        }
+    }
+
+    toArray() {
+        const result = new Array(this.length);
+        for (let i = 0; i < this.length; i++) {
+            result[i] = this.get(i);
+        }
+        return result;
+    }
+
+    // Copies the column to contiguous memory in one native call. The target
+    // defaults to a new TypedArray for number fields and a new Buffer otherwise.
+    gather(target, targetOffset) {
+        if (!target) {
+            const info = this._info;
+            target = info && info.TypedArray ?
+                new info.TypedArray(this.length) :
+                new Buffer(this.length * this.itemSize);
+            targetOffset = 0;
+        }
+        native.marshal.gather(
+            this.buffer, this.byteOffset, this.stride, this.itemSize, this.length,
+            target, targetOffset || 0);
+        return target;
+    }
+
+    // The opposite of gather(): writes the column from contiguous memory.
+    scatter(source, sourceOffset) {
+        assert(source, 'Argument "source" is not a Buffer or a TypedArray.');
+        native.marshal.scatter(
+            this.buffer, this.byteOffset, this.stride, this.itemSize, this.length,
+            source, sourceOffset || 0);
+    }
+}
+
+exports.Column = Column;
+
+exports.columns = function (buffer, count, byteOffset) {
+    assert(Buffer.isBuffer(buffer), 'Argument "buffer" is not a Buffer.');
+    byteOffset = byteOffset || 0;
+    if (count === undefined) {
+        count = Math.floor((buffer.length - byteOffset) / this.size);
+    }
+    buffer = marshal.ensureLength(buffer, byteOffset + count * this.size);
+    const result = {};
+    for (const name of Object.keys(this.fields)) {
+        result[name] = new Column(this, name, buffer, byteOffset, count);
+    }
+    return result;
+};
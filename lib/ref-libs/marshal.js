@@ -0,0 +1,174 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+'use strict';
+const assert = require('assert');
+const ref = require('./ref');
+const primitives = require('./primitives');
+const native = require('../native');
+const marshal = native.marshal;
+
+// Converts whole arrays of plain objects to packed struct arrays and back in
+// one native call, walking a layout descriptor of the struct type instead of
+// running the field setters of every single record.
+// Struct types having fields that cannot be described (strings, unions,
+// other custom types) fall back to the compiled fromObject() and toObject().
+
+exports.packArray = function (array, buffer, byteOffset) {
+    assert(Array.isArray(array), 'Argument "array" is not an Array.');
+    byteOffset = byteOffset || 0;
+    const size = this.size;
+    if (!buffer) {
+        buffer = new Buffer(array.length * size + byteOffset).fill(0);
+    }
+    else {
+        assert(Buffer.isBuffer(buffer), 'Argument "buffer" is not a Buffer.');
+        buffer = ensureLength(buffer, byteOffset + array.length * size);
+    }
+    pack(this, array, 0, array.length, buffer, byteOffset);
+    return buffer;
+};
+
+exports.unpackArray = function (buffer, count, byteOffset) {
+    assert(Buffer.isBuffer(buffer), 'Argument "buffer" is not a Buffer.');
+    byteOffset = byteOffset || 0;
+    const size = this.size;
+    if (count === undefined) {
+        count = Math.floor((buffer.length - byteOffset) / size);
+    }
+    buffer = ensureLength(buffer, byteOffset + count * size);
+    const layout = layoutOf(this);
+    if (layout) {
+        return marshal.unpack(layout, buffer, byteOffset, count);
+    }
+    const result = new Array(count);
+    for (let i = 0; i < count; i++) {
+        const start = byteOffset + i * size;
+        result[i] = new this(buffer.slice(start, start + size)).toObject();
+    }
+    return result;
+};
+
+// Packs very large arrays chunk by chunk, yielding { buffer, start, count }
+// for each, so the native side can consume the records while the rest is
+// still being converted. If _buffer_ is given, it gets reused for every
+// chunk, otherwise each chunk gets its own.
+exports.packChunks = function* (array, chunkLength, buffer) {
+    assert(Array.isArray(array), 'Argument "array" is not an Array.');
+    chunkLength = chunkLength || 4096;
+    assert(chunkLength > 0, 'Argument "chunkLength" is not a positive number.');
+    const size = this.size;
+    if (buffer) {
+        assert(Buffer.isBuffer(buffer), 'Argument "buffer" is not a Buffer.');
+        buffer = ensureLength(buffer, Math.min(chunkLength, array.length) * size);
+    }
+    for (let start = 0; start < array.length; start += chunkLength) {
+        const count = Math.min(chunkLength, array.length - start);
+        let chunk;
+        if (buffer) {
+            chunk = buffer;
+            chunk.fill(0, 0, count * size);
+        }
+        else {
+            chunk = new Buffer(count * size).fill(0);
+        }
+        pack(this, array, start, count, chunk, 0);
+        yield { buffer: chunk, start, count };
+    }
+};
+
+function pack(StructType, array, start, count, buffer, byteOffset) {
+    const layout = layoutOf(StructType);
+    if (layout) {
+        marshal.pack(layout, array, start, count, buffer, byteOffset);
+        return;
+    }
+    const size = StructType.size;
+    for (let i = 0; i < count; i++) {
+        const offset = byteOffset + i * size;
+        StructType.fromObject(array[start + i], buffer.slice(offset, offset + size));
+    }
+}
+
+exports.ensureLength = ensureLength;
+
+function ensureLength(buffer, length) {
+    if (buffer.length >= length) {
+        return buffer;
+    }
+    // Pointers coming from native code are zero length
+    assert(buffer.length === 0, 'Buffer is too small.');
+    return ref.reinterpret(buffer, length);
+}
+
+function layoutOf(StructType) {
+    if (StructType._layout === undefined) {
+        const desc = describe(StructType);
+        StructType._layout = desc ? marshal.newLayout(desc) : null;
+        // the layout is final from now on
+        StructType._instanceCreated = true;
+    }
+    return StructType._layout;
+}
+
+function describe(StructType) {
+    const fields = [];
+    for (const name of Object.keys(StructType.fields)) {
+        const field = StructType.fields[name];
+        let type = field.type;
+        let count = 0;
+        if (type.fixedLength > 0 && type.type) {
+            count = type.fixedLength;
+            type = type.type;
+        }
+        const desc = { name, code: codeOf(type), offset: field.offset, count, layout: null };
+        if (!desc.code && isStructType(type)) {
+            desc.code = 't';
+            desc.layout = describe(type);
+            if (!desc.layout) {
+                return null;
+            }
+        }
+        if (!desc.code) {
+            return null;
+        }
+        fields.push(desc);
+    }
+    return { size: StructType.size, fields };
+}
+
+function codeOf(type) {
+    if (type.indirection > 1) {
+        return 'p';
+    }
+    const info = primitives.find(type);
+    if (info) {
+        return info.code;
+    }
+    if (type.indirection === 1) {
+        if (type.get === ref.types.int64.get) {
+            return 'l';
+        }
+        if (type.get === ref.types.uint64.get) {
+            return 'L';
+        }
+    }
+    return null;
+}
+
+function isStructType(type) {
+    return type.indirection === 1 && typeof type.fromObject === 'function' && type.fields;
+}
@@ -0,0 +1,119 @@
+
+/**
+ * Module dependencies.
+ */
+
+var ref = require('./ref')
+var isArray = Array.isArray
+
+function isNumber (value) {
+  return typeof value === 'number'
+}
+
+/**
+ * Buffer accessor method names, TypedArray constructors and native marshalling
+ * codes (see src/marshal.cpp) of the fixed size number types. The entries are keyed by the type's `get()` function, that way
+ * the "typedef"s like `int` or `char` (which inherit it) are recognized too.
+ */
+
+var kinds = new Map()
+
+;[ [ 'int8', 'Int8', Int8Array, 'c', -0x80, 0x7f ]
+ , [ 'uint8', 'UInt8', Uint8Array, 'C', 0, 0xff ]
+ , [ 'int16', 'Int16', Int16Array, 's', -0x8000, 0x7fff ]
+ , [ 'uint16', 'UInt16', Uint16Array, 'S', 0, 0xffff ]
+ , [ 'int32', 'Int32', Int32Array, 'i', -0x80000000, 0x7fffffff ]
+ , [ 'uint32', 'UInt32', Uint32Array, 'I', 0, 0xffffffff ]
+ , [ 'float', 'Float', Float32Array, 'f', null, null ]
+ , [ 'double', 'Double', Float64Array, 'd', null, null ]
+ ].forEach(function (k) {
+  var type = ref.types[k[0]]
+  var suffix = type.size > 1 ? ref.endianness : ''
+  kinds.set(type.get, {
+      size: type.size
+    , read: 'read' + k[1] + suffix
+    , write: 'write' + k[1] + suffix
+    , TypedArray: k[2]
+    , code: k[3]
+    , min: k[4]
+    , max: k[5]
+    , isChar: type.size === 1
+    , isBool: false
+  })
+})
+
+// `bool` reads as true/false, so it has no TypedArray view
+kinds.set(ref.types.bool.get, {
+    size: ref.types.bool.size
+  , read: 'readUInt' + (ref.types.bool.size * 8) + (ref.types.bool.size > 1 ? ref.endianness : '')
+  , write: 'writeUInt' + (ref.types.bool.size * 8) + (ref.types.bool.size > 1 ? ref.endianness : '')
+  , TypedArray: null
+  , code: 'B'
+  , min: null
+  , max: null
+  , isChar: false
+  , isBool: true
+})
+
+/**
+ * Returns the accessor info of a primitive number type, or `null` if _type_
+ * is anything else (pointers, 64 bit integers, structs, arrays, etc).
+ */
+
+exports.find = function find (type) {
+  if (!type || type.indirection !== 1 || typeof type.get !== 'function') {
+    return null
+  }
+  return kinds.get(type.get) || null
+}
+
+/**
+ * Tells whether _value_ could be stored by a TypedArray view of _info_'s type
+ * the same way as by the Buffer writers. TypedArrays wrap integers around
+ * silently, where the writers throw, so those have to take the slow path.
+ */
+
+var fits = exports.fits = function fits (info, value) {
+  return typeof value === 'number' && (info.min === null || (value >= info.min && value <= info.max))
+}
+
+/**
+ * `fits()` for each element of an Array or TypedArray.
+ */
+
+exports.fitsAll = function fitsAll (info, values) {
+  if (info.min === null || values instanceof info.TypedArray) {
+    return !isArray(values) || values.every(isNumber)
+  }
+  for (var i = 0; i < values.length; i++) {
+    if (!fits(info, values[i])) {
+      return false
+    }
+  }
+  return true
+}
+
+/**
+ * Returns a JS expression reading the value of _info_'s type from the Buffer
+ * named _buf_ at the constant _offset_.
+ */
+
+exports.readExpr = function readExpr (info, buf, offset) {
+  var expr = buf + '.' + info.read + '(' + offset + ')'
+  return info.isBool ? '(' + expr + ' ? true : false)' : expr
+}
+
+/**
+ * Returns a JS statement writing the JS expression _value_ as _info_'s type
+ * into the Buffer named _buf_ at the constant _offset_. The conversions are the
+ * same as the types' `set()` functions do.
+ */
+
+exports.writeStmt = function writeStmt (info, buf, offset, value) {
+  if (info.isChar) {
+    value = '(typeof ' + value + ' === "string" ? ' + value + '.charCodeAt(0) : ' + value + ')'
+  } else if (info.isBool) {
+    value = '(typeof ' + value + ' === "number" ? ' + value + ' : ' + value + ' ? 1 : 0)'
+  }
+  return buf + '.' + info.write + '(' + value + ', ' + offset + ');'
+}
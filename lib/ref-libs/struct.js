@@ -50,6 +50,9 @@ var ref = require('./ref')
 var util = require('util')
 var assert = require('assert')
 var debug = require('debug')('ref:struct')
+var primitives = require('./primitives')
+var marshal = require('./marshal')
+var columns = require('./columns')
 
 /**
  * Module exports.
@@ -78,6 +81,9 @@ function Struct () {
       return new StructType(arg, data)
     }
     debug('creating new struct instance')
+    if (!StructType._compiled) {
+      compile(StructType)
+    }
     var store
     if (Buffer.isBuffer(arg)) {
       debug('using passed-in Buffer instance to back the struct', arg)
@@ -114,7 +120,13 @@ function Struct () {
   })
 
   StructType.defineProperty = defineProperty
+  StructType.getLayout = getLayout
   StructType.toString = toString
+  StructType.fromObject = fromObject
+  StructType.packArray = marshal.packArray
+  StructType.unpackArray = marshal.unpackArray
+  StructType.packChunks = marshal.packChunks
+  StructType.columns = columns.columns
   StructType.fields = {}
 
   var opt = (arguments.length > 0 && arguments[1]) ? arguments[1] : {};
@@ -128,19 +140,31 @@ function Struct () {
 
   // Read the fields list and apply all the fields to the struct
   // TODO: Better arg handling... (maybe look at ES6 binary data API?)
+  // The layout gets calculated once after all of the fields are in place,
+  // instead of once per field, or gets taken from `opt.layout` (see getLayout())
+  // if that's made for the same field types.
   var arg = arguments[0]
-  if (Array.isArray(arg)) {
-    // legacy API
-    arg.forEach(function (a) {
-      var type = a[0]
-      var name = a[1]
-      StructType.defineProperty(name, type)
-    })
-  } else if (typeof arg === 'object') {
-    Object.keys(arg).forEach(function (name) {
-      var type = arg[name]
-      StructType.defineProperty(name, type)
-    })
+  StructType._deferRecalc = true
+  try {
+    if (Array.isArray(arg)) {
+      // legacy API
+      arg.forEach(function (a) {
+        var type = a[0]
+        var name = a[1]
+        StructType.defineProperty(name, type)
+      })
+    } else if (typeof arg === 'object') {
+      Object.keys(arg).forEach(function (name) {
+        var type = arg[name]
+        StructType.defineProperty(name, type)
+      })
+    }
+  } finally {
+    StructType._deferRecalc = false
+  }
+  StructType.layoutApplied = Boolean(opt.layout) && applyLayout(StructType, opt.layout)
+  if (!StructType.layoutApplied && Object.keys(StructType.fields).length) {
+    recalc(StructType)
   }
 
   return StructType
@@ -177,6 +201,58 @@ function set (buffer, offset, value) {
   }
 }
 
+/**
+ * Creates a new instance of the Struct "type" with the fields set from _obj_,
+ * backed by _buffer_ if it's given.
+ */
+
+function fromObject (obj, buffer) {
+  if (!this._compiled) {
+    compile(this)
+  }
+  return this._fromObject(obj, buffer)
+}
+
+/**
+ * Replaces the generic field accessors with ones specialized for the final
+ * layout. Number fields get read and written by Buffer methods at constant
+ * offsets, instead of dispatching on the type by `ref.get()` and `ref.set()`.
+ * Also compiles `toObject()` and `fromObject()` doing all of the fields in one
+ * pass. Runs when the first instance gets created (no fields can be added
+ * after that), or when fields have been added since the last run.
+ */
+
+function compile (struct) {
+  debug('compiling struct "type" accessors')
+  var toObjectBody = 'var buf = this["ref.buffer"]; return {'
+  var fromObjectBody = 'var s = new StructType(buffer); var buf = s["ref.buffer"]; var value;'
+  Object.keys(struct.fields).forEach(function (name) {
+    var field = struct.fields[name]
+    var key = JSON.stringify(name)
+    var info = primitives.find(field.type)
+    if (info) {
+      var read = primitives.readExpr(info, 'buf', field.offset)
+      var write = primitives.writeStmt(info, 'buf', field.offset, 'value')
+      Object.defineProperty(struct.prototype, name, {
+          enumerable: true
+        , configurable: true
+        , get: new Function('var buf = this["ref.buffer"]; return ' + read + ';')
+        , set: new Function('value', 'var buf = this["ref.buffer"]; ' + write)
+      })
+      toObjectBody += key + ': ' + read + ','
+      fromObjectBody += 'if ((value = obj[' + key + ']) !== undefined) { ' + write + ' }'
+    } else {
+      toObjectBody += key + ': this[' + key + '],'
+      fromObjectBody += 'if ((value = obj[' + key + ']) !== undefined) { s[' + key + '] = value; }'
+    }
+  })
+  toObjectBody += '};'
+  fromObjectBody += 'return s;'
+  struct.prototype.toObject = new Function(toObjectBody)
+  struct._fromObject = new Function('StructType', 'return function (obj, buffer) { ' + fromObjectBody + ' };')(struct)
+  struct._compiled = true
+}
+
 /**
  * Custom `toString()` override for struct type instances.
  */
@@ -215,6 +291,9 @@ function defineProperty (name, type) {
   this.fields[name] = field
   var cacheName = '_cache' + name
 
+  // accessors and toObject() compiled without this field get compiled again
+  this._compiled = false
+
   // define the getter/setter property
   var desc = { enumerable: true , configurable: true }
   desc.get = function () {
@@ -235,11 +314,57 @@ function defineProperty (name, type) {
   }
 
   // calculate the new size and field offsets
-  recalc(this)
+  if (!this._deferRecalc) {
+    recalc(this)
+  }
 
   Object.defineProperty(this.prototype, name, desc)
 }
 
+/**
+ * Returns the layout of the struct as a JSON serializable object: its size,
+ * alignment, and the offset of each field along with the size, alignment and
+ * indirection of its type, the things the layout depends on.
+ */
+
+function getLayout () {
+  var fields = this.fields
+  return {
+      size: this.size
+    , alignment: this.alignment
+    , isPacked: this.isPacked
+    , fields: Object.keys(fields).map(function (name) {
+        var type = fields[name].type
+        return [ fields[name].offset, type.size || 0, type.alignment || 0, type.indirection ]
+      })
+  }
+}
+
+/**
+ * Takes a layout made by `getLayout()`, if it has been made for field types of
+ * the same sizes, alignments and indirections. Returns whether it has.
+ */
+
+function applyLayout (struct, layout) {
+  var fieldNames = Object.keys(struct.fields)
+  if (layout.isPacked !== struct.isPacked || layout.fields.length !== fieldNames.length) {
+    return false
+  }
+  for (var i = 0; i < fieldNames.length; i++) {
+    var type = struct.fields[fieldNames[i]].type
+    var field = layout.fields[i]
+    if (field[1] !== (type.size || 0) || field[2] !== (type.alignment || 0) || field[3] !== type.indirection) {
+      return false
+    }
+  }
+  for (var i = 0; i < fieldNames.length; i++) {
+    struct.fields[fieldNames[i]].offset = layout.fields[i][0]
+  }
+  struct.size = layout.size
+  struct.alignment = layout.alignment
+  return true
+}
+
 function recalc (struct) {
 
   // reset size and alignment
@@ -63,6 +63,7 @@ function Union () {
   })
 
   UnionType.defineProperty = defineProperty
+  UnionType.getLayout = getLayout
   UnionType.toString = toString
   UnionType.fields = {}
 
@@ -73,13 +74,25 @@ function Union () {
   UnionType.get = get
   UnionType.set = set
 
-  // Read the fields list
+  // Read the fields list. The size gets calculated once after all of the
+  // fields are in place, or gets taken from `opt.layout` (see getLayout())
+  // if that's made for the same field types.
+  var opt = arguments[1] || {}
   var arg = arguments[0]
-  if (typeof arg === 'object') {
-    Object.keys(arg).forEach(function (name) {
-      var type = arg[name];
-      UnionType.defineProperty(name, type);
-    })
+  UnionType._deferRecalc = true
+  try {
+    if (typeof arg === 'object') {
+      Object.keys(arg).forEach(function (name) {
+        var type = arg[name];
+        UnionType.defineProperty(name, type);
+      })
+    }
+  } finally {
+    UnionType._deferRecalc = false
+  }
+  UnionType.layoutApplied = Boolean(opt.layout) && applyLayout(UnionType, opt.layout)
+  if (!UnionType.layoutApplied && Object.keys(UnionType.fields).length) {
+    recalc(UnionType)
   }
 
   return UnionType
@@ -156,7 +169,9 @@ function defineProperty (name, type) {
   var cacheName = '_cache' + name
 
   // calculate the new size and alignment
-  recalc(this);
+  if (!this._deferRecalc) {
+    recalc(this);
+  }
 
   function get () {
     if (this[cacheName]) {
@@ -177,6 +192,45 @@ function defineProperty (name, type) {
   }
 }
 
+/**
+ * Returns the layout of the union as a JSON serializable object: its size,
+ * alignment, and the size, alignment and indirection of each field's type.
+ */
+
+function getLayout () {
+  var fields = this.fields
+  return {
+      size: this.size
+    , alignment: this.alignment
+    , fields: Object.keys(fields).map(function (name) {
+        var type = fields[name].type
+        return [ type.size || 0, type.alignment || 0, type.indirection ]
+      })
+  }
+}
+
+/**
+ * Takes a layout made by `getLayout()`, if it has been made for field types of
+ * the same sizes, alignments and indirections. Returns whether it has.
+ */
+
+function applyLayout (union, layout) {
+  var fieldNames = Object.keys(union.fields)
+  if (layout.fields.length !== fieldNames.length) {
+    return false
+  }
+  for (var i = 0; i < fieldNames.length; i++) {
+    var type = union.fields[fieldNames[i]].type
+    var field = layout.fields[i]
+    if (field[0] !== (type.size || 0) || field[1] !== (type.alignment || 0) || field[2] !== type.indirection) {
+      return false
+    }
+  }
+  union.size = layout.size
+  union.alignment = layout.alignment
+  return true
+}
+
 function recalc (union) {
   // reset size and alignment
   union.size = 0
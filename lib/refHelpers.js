@@ -23,6 +23,7 @@ exports.isUnionType = isUnionType;
 exports.isStructType = isStructType;
 exports.isFunctionType = isFunctionType;
 exports.isStringType = isStringType;
+exports.isPointerLike = isPointerLike;
 
 function isPointerType(type) {
     const _type = ref.coerceType(type);
@@ -55,4 +56,14 @@ function isFunctionType(type) {
 function isStringType(type) {
     const _type = ref.coerceType(type);
     return _type === ref.types.CString;
-}
\ No newline at end of file
+}
+
+const hasSharedArrayBuffer = typeof SharedArrayBuffer !== 'undefined';
+
+// Values that native code accepts as pointers without conversion:
+// Buffers, TypedArrays, DataViews, ArrayBuffers and SharedArrayBuffers.
+function isPointerLike(value) {
+    return ArrayBuffer.isView(value) ||
+        value instanceof ArrayBuffer ||
+        (hasSharedArrayBuffer && value instanceof SharedArrayBuffer);
+}
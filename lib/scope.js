@@ -21,6 +21,7 @@ const a = verify.a;
 const ert = verify.ert;
 const assert = require('assert');
 const Promise = require('bluebird');
+const Arena = require('./Arena');
 
 module.exports = scope;
 
@@ -80,17 +81,31 @@ scope.escape = function (value) {
 scope.begin = begin;
 scope.end = end;
 
+// The arena of the current scope layer, created on first use and freed by
+// end() after the disposables. In async scopes, take it before the first
+// yield, because other scopes could begin in the meantime.
+Object.defineProperty(scope, 'arena', {
+    get() {
+        assert(layers.length, 'There is no active scope.');
+        const layer = layers[layers.length - 1];
+        if (!layer.arena) {
+            layer.arena = new Arena();
+        }
+        return layer.arena;
+    }
+});
+
 const layers = [];
 
 function begin() {
-    layers.push(new Set());
+    layers.push({ disposables: new Set(), arena: null });
 }
 
 function end() {
     const last = layers.pop();
     let promises = null;
     if (last) {
-        for (let disposable of last.values()) {
+        for (let disposable of last.disposables.values()) {
             const result = disposable.dispose();
             if (result && _.isFunction(result.then)) {
                 if (!promises) {
@@ -99,6 +114,13 @@ function end() {
                 promises.push(Promise.resolve(result));
             }
         }
+        if (last.arena) {
+            if (promises) {
+                const arena = last.arena;
+                return Promise.all(promises).finally(() => arena.free());
+            }
+            last.arena.free();
+        }
     }
     if (promises) {
         return Promise.all(promises);
@@ -113,7 +135,7 @@ function add(disposable, layer) {
     }
     const currentLayer = layer || (layers.length ? layers[layers.length - 1] : null);
     if (currentLayer) {
-        currentLayer.add(disposable);
+        currentLayer.disposables.add(disposable);
     }
 }
 
@@ -132,9 +154,9 @@ function escape(result, propagate) {
 
     if (currentLayer) {
         for (let disposable of enumDisposable(result)) {
-            currentLayer.delete(disposable);
+            currentLayer.disposables.delete(disposable);
             if (prevLayer) {
-                prevLayer.add(disposable);
+                prevLayer.disposables.add(disposable);
             }
         }
     }
@@ -145,6 +167,12 @@ function* enumDisposable(result) {
     if (result instanceof Disposable) {
         yield result;
     }
+    else if (ArrayBuffer.isView(result)) {
+        // views over owned native memory (see ArgQualifiers)
+        if (result.disposable instanceof Disposable) {
+            yield result.disposable;
+        }
+    }
     else if (_.isArray(result)) {
         for (let item of result) {
             yield* enumDisposable(item);
@@ -0,0 +1,67 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "arena.h"
+#include "deps.h"
+#include "helpers.h"
+#include <cstdlib>
+
+using namespace std;
+using namespace v8;
+using namespace node;
+using namespace fastcall;
+
+namespace {
+// Blocks of arenas are zero filled native memory, that the GC doesn't own:
+// the Buffers returned point to it without freeing it, the arena releases
+// all of its blocks at once by freeBlock() calls.
+NAN_METHOD(newBlock)
+{
+    if (!info[0]->IsNumber()) {
+        return Nan::ThrowTypeError("1st argument is not a number.");
+    }
+
+    size_t size = info[0]->Uint32Value();
+    if (size == 0) {
+        return Nan::ThrowTypeError("Block size should be positive.");
+    }
+    char* ptr = reinterpret_cast<char*>(calloc(size, 1));
+    if (!ptr) {
+        return Nan::ThrowError("Out of memory.");
+    }
+    Nan::AdjustExternalMemory(static_cast<int>(size));
+    info.GetReturnValue().Set(WrapPointer(ptr, size));
+}
+
+NAN_METHOD(freeBlock)
+{
+    if (!Buffer::HasInstance(info[0])) {
+        return Nan::ThrowTypeError("1st argument is not a Buffer.");
+    }
+
+    auto size = Buffer::Length(info[0]);
+    free(Buffer::Data(info[0]));
+    Nan::AdjustExternalMemory(-static_cast<int>(size));
+}
+}
+
+NAN_MODULE_INIT(fastcall::InitArena)
+{
+    auto arena = Nan::New<Object>();
+    Nan::Set(target, Nan::New<String>("arena").ToLocalChecked(), arena);
+    Nan::Set(arena, Nan::New<String>("newBlock").ToLocalChecked(), Nan::New<FunctionTemplate>(newBlock)->GetFunction());
+    Nan::Set(arena, Nan::New<String>("freeBlock").ToLocalChecked(), Nan::New<FunctionTemplate>(freeBlock)->GetFunction());
+}
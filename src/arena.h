@@ -18,5 +18,5 @@ limitations under the License.
 #include <nan.h>
 
 namespace fastcall {
-NAN_MODULE_INIT(InitMutex);
+NAN_MODULE_INIT(InitArena);
 }
@@ -16,6 +16,7 @@ limitations under the License.
 
 #include "deps.h"
 #include "callbackimpl.h"
+#include "executor.h"
 #include "helpers.h"
 #include "loop.h"
 #include "statics.h"
@@ -44,7 +45,7 @@ char OtherThreadCallbackHandler(DCArgs* args, DCValue* result, CallbackUserData*
 {
     std::unique_lock<std::mutex> ulock(cbUserData->lock);
 
-    auto task = [args, result, cbUserData]() {
+    TTask task = [args, result, cbUserData]() {
         V8ThreadCallbackHandler(args, result, cbUserData);
 
         {
@@ -53,7 +54,11 @@ char OtherThreadCallbackHandler(DCArgs* args, DCValue* result, CallbackUserData*
         }
     };
 
-    cbUserData->loop->DoInMainLoop(std::move(task));
+    // A synchronous call of an executor blocks the main thread,
+    // that runs the task instead of the main loop.
+    if (!Executor::DoInWaitingThread(task)) {
+        cbUserData->loop->DoInMainLoop(std::move(task));
+    }
 
     cbUserData->cond.wait(ulock);
 
@@ -0,0 +1,306 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "callplan.h"
+#include "deps.h"
+#include "executor.h"
+#include "helpers.h"
+#include "librarylock.h"
+#include <memory>
+#include <string>
+
+using namespace std;
+using namespace v8;
+using namespace node;
+using namespace fastcall;
+
+CallPlan::~CallPlan()
+{
+    if (syncVM) {
+        dcFree(syncVM);
+    }
+}
+
+int CallPlan::Run(DCCallVM* vm, const double* inputs, double* results, double* slots, char* done) const
+{
+    int failed = -1;
+    double args[PackedFunction::maxArgs];
+    for (unsigned i = 0; i < steps.size(); i++) {
+        const auto& step = steps[i];
+        if (failed >= 0 && !step.always) {
+            continue;
+        }
+        bool ready = true;
+        for (unsigned j = 0; j < step.argCount; j++) {
+            const auto& arg = step.args[j];
+            auto index = static_cast<unsigned>(arg.value);
+            switch (arg.source) {
+            case constant:
+                args[j] = arg.value;
+                break;
+            case input:
+                args[j] = inputs[index];
+                break;
+            case result:
+                ready = ready && done[index] == stepSucceeded;
+                args[j] = results[index];
+                break;
+            case scratch:
+                ready = ready && (arg.writer < 0 || done[arg.writer] == stepSucceeded);
+                args[j] = slots[index];
+                break;
+            }
+        }
+        if (!ready) {
+            // depends on a skipped or failed step
+            continue;
+        }
+        results[i] = functions[step.func].Call(vm, reinterpret_cast<const char*>(args));
+        if (!Passes(step, results[i])) {
+            done[i] = stepFailed;
+            if (failed < 0) {
+                failed = i;
+            }
+            continue;
+        }
+        done[i] = stepSucceeded;
+        if (step.store >= 0) {
+            slots[step.store] = results[i];
+        }
+    }
+    ResetUnwrittenSlots(slots, done);
+    return failed;
+}
+
+// Slots of the steps that haven't succeeded would keep the values of an
+// earlier run (of call programs), unless they've been written by another step.
+void CallPlan::ResetUnwrittenSlots(double* slots, const char* done) const
+{
+    for (unsigned i = 0; i < steps.size(); i++) {
+        auto store = steps[i].store;
+        if (store < 0 || done[i] == stepSucceeded) {
+            continue;
+        }
+        bool written = false;
+        for (unsigned j = 0; j < steps.size() && !written; j++) {
+            written = steps[j].store == store && done[j] == stepSucceeded;
+        }
+        if (!written) {
+            slots[store] = 0;
+        }
+    }
+}
+
+int CallPlan::RunSync(const double* inputs, double* results, double* slots)
+{
+    if (!syncVM) {
+        syncVM = dcNewCallVM(packedCallVMSize);
+    }
+    syncDone.assign(steps.size(), stepSkipped);
+    return Run(syncVM, inputs, results, slots, syncDone.data());
+}
+
+bool CallPlan::Passes(const Step& step, double result)
+{
+    switch (step.check) {
+    case eq:
+        return result == step.checkValue;
+    case ne:
+        return result != step.checkValue;
+    case lt:
+        return result < step.checkValue;
+    case le:
+        return result <= step.checkValue;
+    case gt:
+        return result > step.checkValue;
+    case ge:
+        return result >= step.checkValue;
+    default:
+        return true;
+    }
+}
+
+namespace {
+// An execution of a plan, as a single work item.
+struct PlanCall : AsyncCall {
+    PlanCall(const Local<Value>& planObj, const CallPlan* plan, vector<double>&& inputs, const Local<Function>& callback)
+        : planObj(planObj)
+        , plan(plan)
+        , inputs(move(inputs))
+        , results(plan->steps.size(), 0)
+        , scratch(plan->scratchCount, 0)
+        , done(plan->steps.size(), CallPlan::stepSkipped)
+        , callback(callback)
+    {
+    }
+
+    void Execute() override
+    {
+        auto vm = dcNewCallVM(packedCallVMSize);
+        failed = plan->Run(vm, inputs.data(), results.data(), scratch.data(), done.data());
+        dcFree(vm);
+    }
+
+    // callback(null, failedStep, results), failedStep is -1 on success,
+    // results of the skipped steps are undefined.
+    void Complete() override
+    {
+        auto resultsArr = Nan::New<Array>(results.size());
+        for (unsigned i = 0; i < results.size(); i++) {
+            if (done[i]) {
+                Nan::Set(resultsArr, i, Nan::New(results[i]));
+            }
+        }
+        Local<Value> args[] = { Nan::Null(), Nan::New(failed), resultsArr };
+        Nan::New(callback)->Call(Nan::Undefined(), 3, args);
+    }
+
+    void Fail(const Local<Value>& error) override
+    {
+        Local<Value> args[] = { error };
+        Nan::New(callback)->Call(Nan::Undefined(), 1, args);
+    }
+
+private:
+    Nan::Global<Value> planObj;
+    const CallPlan* plan;
+    vector<double> inputs;
+    vector<double> results;
+    vector<double> scratch; // temporaries of a single run
+    vector<char> done;
+    Nan::Global<Function> callback;
+    int failed = -1;
+};
+
+// newPlan(functions, steps, inputCount, scratchCount): functions are
+// [ptr, argCodes, resultCode] descriptors, steps is a Float64Array of
+// encoded steps.
+NAN_METHOD(newPlan)
+{
+    unique_ptr<CallPlan> plan(new CallPlan());
+    auto functions = info[0].As<Array>();
+    for (uint32_t i = 0; i < functions->Length(); i++) {
+        auto desc = Nan::Get(functions, i).ToLocalChecked().As<Array>();
+        Nan::Utf8String argCodes(Nan::Get(desc, 1).ToLocalChecked());
+        Nan::Utf8String resultCode(Nan::Get(desc, 2).ToLocalChecked());
+        PackedFunction func;
+        if (!func.Init(
+                UnwrapPointer(Nan::Get(desc, 0).ToLocalChecked()),
+                string(*argCodes, argCodes.length()),
+                resultCode.length() ? (*resultCode)[0] : 'v')) {
+            return Nan::ThrowTypeError("Function cannot be called by a plan.");
+        }
+        plan->functions.push_back(func);
+    }
+    Nan::TypedArrayContents<double> encoded(info[1]);
+    plan->inputCount = info[2]->Uint32Value();
+    plan->scratchCount = info[3]->Uint32Value();
+    auto stepCount = encoded.length() / CallPlan::encodedStepSize;
+    vector<int> writers(plan->scratchCount, -1);
+    for (unsigned i = 0; i < stepCount; i++) {
+        auto data = *encoded + i * CallPlan::encodedStepSize;
+        CallPlan::Step step;
+        step.func = static_cast<unsigned>(data[0]);
+        step.argCount = static_cast<unsigned>(data[1]);
+        step.check = static_cast<CallPlan::Check>(static_cast<int>(data[2]));
+        step.checkValue = data[3];
+        step.always = data[4] != 0;
+        step.store = static_cast<int>(data[5]);
+        if (step.func >= plan->functions.size() || step.argCount != plan->functions[step.func].argCount ||
+            step.store >= static_cast<int>(plan->scratchCount)) {
+            return Nan::ThrowRangeError("Invalid plan step.");
+        }
+        for (unsigned j = 0; j < step.argCount; j++) {
+            auto& arg = step.args[j];
+            arg.source = static_cast<CallPlan::Source>(static_cast<int>(data[6 + j * 2]));
+            arg.value = data[7 + j * 2];
+            if ((arg.source == CallPlan::input && arg.value >= plan->inputCount) ||
+                (arg.source == CallPlan::result && arg.value >= i) ||
+                (arg.source == CallPlan::scratch && arg.value >= plan->scratchCount)) {
+                return Nan::ThrowRangeError("Invalid plan argument.");
+            }
+            arg.writer = arg.source == CallPlan::scratch ? writers[static_cast<unsigned>(arg.value)] : -1;
+        }
+        if (step.store >= 0) {
+            writers[step.store] = i;
+        }
+        plan->steps.push_back(step);
+    }
+    info.GetReturnValue().Set(Wrap<CallPlan>(plan.release()));
+}
+
+// run(plan, inputs, callback, executor, lock, shared, stats, gate)
+NAN_METHOD(run)
+{
+    auto plan = Unwrap<CallPlan>(info[0]);
+    auto inputsArr = info[1].As<Array>();
+    if (inputsArr->Length() != plan->inputCount) {
+        return Nan::ThrowRangeError("Invalid number of plan inputs.");
+    }
+    vector<double> inputs(plan->inputCount);
+    for (unsigned i = 0; i < plan->inputCount; i++) {
+        inputs[i] = Nan::Get(inputsArr, i).ToLocalChecked()->NumberValue();
+    }
+    CallContext context;
+    ReadCallContext(info, 3, context);
+    auto call = new PlanCall(info[0], plan, move(inputs), info[2].As<Function>());
+    call->Start(context);
+}
+
+// runSync(plan, inputs, results, scratch, executor, lock, shared): runs
+// a plan by a single transition, the arguments are Float64Arrays
+// preallocated by the caller. Returns the index of the failed step, or -1.
+// Like synchronous calls, it runs on the thread of the executor, or
+// takes the lock of a synchronized library.
+NAN_METHOD(runSync)
+{
+    auto plan = Unwrap<CallPlan>(info[0]);
+    Nan::TypedArrayContents<double> inputs(info[1]);
+    Nan::TypedArrayContents<double> results(info[2]);
+    Nan::TypedArrayContents<double> scratch(info[3]);
+    if (inputs.length() < plan->inputCount || results.length() < plan->steps.size() || scratch.length() < plan->scratchCount) {
+        return Nan::ThrowRangeError("Plan buffers are too small.");
+    }
+    CallContext context;
+    ReadCallContext(info, 4, context);
+    int failed = -1;
+    auto call = [&]() { failed = plan->RunSync(*inputs, *results, *scratch); };
+    if (context.executor) {
+        if (!context.executor->RunSync(TTask(call))) {
+            return Nan::ThrowError("Synchronous calls of a queued library cannot be made by callbacks of its synchronous calls.");
+        }
+    }
+    else if (context.lock) {
+        context.lock->Lock(context.shared);
+        call();
+        context.lock->Unlock(context.shared);
+    }
+    else {
+        call();
+    }
+    info.GetReturnValue().Set(failed);
+}
+}
+
+NAN_MODULE_INIT(fastcall::InitCallPlan)
+{
+    auto plan = Nan::New<Object>();
+    Nan::Set(target, Nan::New<String>("plan").ToLocalChecked(), plan);
+    Nan::Set(plan, Nan::New<String>("newPlan").ToLocalChecked(), Nan::New<FunctionTemplate>(newPlan)->GetFunction());
+    Nan::Set(plan, Nan::New<String>("run").ToLocalChecked(), Nan::New<FunctionTemplate>(run)->GetFunction());
+    Nan::Set(plan, Nan::New<String>("runSync").ToLocalChecked(), Nan::New<FunctionTemplate>(runSync)->GetFunction());
+}
@@ -0,0 +1,101 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+#include "packedcall.h"
+#include <nan.h>
+#include <vector>
+
+namespace fastcall {
+// A sequence of packed calls (see packedcall.h), where the arguments of a
+// step are constants, inputs of the plan, results of earlier steps, or
+// scratch slots, a step could store its result into a scratch slot too.
+// A step could check its result, if that fails, the rest of the steps get
+// skipped, except the ones marked as always (cleanup, like closing a file),
+// which run if the steps they depend on have succeeded. Reading a slot
+// depends on the last earlier step storing into it.
+// Plans are executed as a whole, either on a worker thread, or
+// synchronously (call programs), by a single transition from JS.
+struct CallPlan {
+    enum Check {
+        none,
+        eq,
+        ne,
+        lt,
+        le,
+        gt,
+        ge
+    };
+
+    enum Source {
+        constant,
+        input,
+        result,
+        scratch
+    };
+
+    // States of the steps in a run.
+    enum StepState : char {
+        stepSkipped,
+        stepSucceeded,
+        stepFailed
+    };
+
+    struct Arg {
+        Source source;
+        double value; // the constant, or the index of the input, step or slot
+        int writer; // of slots, the last earlier step storing into it, or -1
+    };
+
+    struct Step {
+        unsigned func;
+        unsigned argCount;
+        Check check;
+        double checkValue;
+        bool always;
+        int store; // scratch slot of the result, or -1
+        Arg args[PackedFunction::maxArgs];
+    };
+
+    // Doubles per step in the encoded form: func, argCount, check,
+    // checkValue, always, store, then (source, value) pairs of the arguments.
+    static const unsigned encodedStepSize = 6 + PackedFunction::maxArgs * 2;
+
+    ~CallPlan();
+
+    std::vector<PackedFunction> functions;
+    std::vector<Step> steps;
+    unsigned inputCount = 0;
+    unsigned scratchCount = 0;
+
+    // Returns the index of the first failed step, or -1. States of the
+    // steps get written to done.
+    int Run(DCCallVM* vm, const double* inputs, double* results, double* slots, char* done) const;
+
+    // Runs on the main thread, reusing the same call VM.
+    int RunSync(const double* inputs, double* results, double* slots);
+
+private:
+    static bool Passes(const Step& step, double result);
+    void ResetUnwrittenSlots(double* slots, const char* done) const;
+
+    DCCallVM* syncVM = nullptr;
+    std::vector<char> syncDone;
+};
+
+NAN_MODULE_INIT(InitCallPlan);
+}
@@ -0,0 +1,246 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "callring.h"
+#include "deps.h"
+#include "helpers.h"
+#include <cstring>
+#include <thread>
+
+using namespace std;
+using namespace v8;
+using namespace node;
+using namespace fastcall;
+
+namespace {
+const unsigned spinCount = 64;
+
+template <typename T>
+inline T Load(const char* ptr)
+{
+    T value;
+    memcpy(&value, ptr, sizeof(T));
+    return value;
+}
+
+template <typename T>
+inline void Store(char* ptr, T value)
+{
+    memcpy(ptr, &value, sizeof(T));
+}
+}
+
+CallRing::CallRing(const Local<Value>& buffer, char* memory, unsigned capacity)
+    : buffer(buffer)
+    , capacity(capacity)
+    , control(reinterpret_cast<atomic<uint32_t>*>(memory))
+    , submissions(memory + headerSize)
+    , completions(memory + headerSize + capacity * entrySize)
+    , functionCount(0)
+    , vm(dcNewCallVM(packedCallVMSize))
+    , handle(new uv_async_t)
+{
+    int r = uv_async_init(uv_default_loop(), handle, Completed);
+    assert(!r);
+    handle->data = static_cast<void*>(this);
+    uv_unref((uv_handle_t*)handle);
+    r = uv_thread_create(&thread, ThreadMain, this);
+    assert(!r);
+}
+
+CallRing::~CallRing()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cond.notify_one();
+    uv_thread_join(&thread);
+    dcFree(vm);
+    uv_close((uv_handle_t*)handle, DeleteUVAsyncHandle);
+}
+
+// Functions can be registered while the ring is running, the thread
+// sees only those that have been published by functionCount.
+int CallRing::Register(DCpointer funcPtr, const string& argCodes, char resultCode)
+{
+    auto index = functionCount.load();
+    if (index == maxFunctions || !functions[index].Init(funcPtr, argCodes, resultCode)) {
+        return -1;
+    }
+    functionCount.store(index + 1);
+    return index;
+}
+
+void CallRing::Notify()
+{
+    lock_guard<std::mutex> lock(mutex);
+    cond.notify_one();
+}
+
+// Wait() and Run() store their side of the handshake (waiting, cqTail), then
+// load the other side's, both sequentially consistent, so at least one of
+// them sees the other's store, and the wakeup doesn't get lost.
+void CallRing::Wait(const Local<Function>& callback)
+{
+    waiter.Reset(callback);
+    uv_ref((uv_handle_t*)handle);
+    control[waiting].store(1, memory_order_seq_cst);
+    if (control[cqTail].load(memory_order_seq_cst) != control[cqHead].load() && control[waiting].exchange(0)) {
+        uv_async_send(handle);
+    }
+}
+
+void CallRing::Run()
+{
+    uint32_t head = control[sqHead].load();
+    for (;;) {
+        if (control[sqTail].load(memory_order_acquire) == head && !WaitForSubmissions(head)) {
+            return;
+        }
+        auto index = head % capacity;
+        auto tail = control[cqTail].load(memory_order_relaxed);
+        Execute(submissions + index * entrySize, completions + (tail % capacity) * completionSize);
+        control[cqTail].store(tail + 1, memory_order_seq_cst);
+        control[sqHead].store(++head, memory_order_release);
+        if (control[waiting].load(memory_order_seq_cst) && control[waiting].exchange(0)) {
+            uv_async_send(handle);
+        }
+    }
+}
+
+// Spins for a while, then sleeps until JS notifies (see Notify()).
+// Returns false if the ring is being released.
+bool CallRing::WaitForSubmissions(uint32_t head)
+{
+    for (unsigned i = 0; i < spinCount; i++) {
+        this_thread::yield();
+        if (control[sqTail].load(memory_order_acquire) != head) {
+            return true;
+        }
+    }
+    unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        if (stopping) {
+            return false;
+        }
+        control[sleeping].store(1);
+        if (control[sqTail].load() != head) {
+            control[sleeping].store(0);
+            return true;
+        }
+        cond.wait(lock);
+        control[sleeping].store(0);
+    }
+}
+
+// Completion: uint32 sequence number, uint32 status, double result
+void CallRing::Execute(const char* entry, char* completion)
+{
+    auto funcIndex = Load<uint32_t>(entry);
+    uint32_t status = 0;
+    double result = 0;
+    if (funcIndex < functionCount.load()) {
+        result = functions[funcIndex].Call(vm, entry + 8);
+    }
+    else {
+        status = 1;
+    }
+    Store<uint32_t>(completion, control[sqHead].load(memory_order_relaxed));
+    Store<uint32_t>(completion + 4, status);
+    Store<double>(completion + 8, result);
+}
+
+void CallRing::ThreadMain(void* arg)
+{
+    static_cast<CallRing*>(arg)->Run();
+}
+
+void CallRing::Completed(uv_async_t* handle)
+{
+    Nan::HandleScope scope;
+
+    auto self = static_cast<CallRing*>(handle->data);
+    uv_unref((uv_handle_t*)handle);
+    if (self->waiter.IsEmpty()) {
+        return;
+    }
+    auto callback = Nan::New(self->waiter);
+    self->waiter.Reset();
+    callback->Call(Nan::Undefined(), 0, nullptr);
+}
+
+namespace {
+NAN_METHOD(newCallRing)
+{
+    if (!info[0]->IsSharedArrayBuffer()) {
+        return Nan::ThrowTypeError("1st argument is not a SharedArrayBuffer.");
+    }
+    auto contents = info[0].As<SharedArrayBuffer>()->GetContents();
+    auto capacity = info[1]->Uint32Value();
+    if (!capacity || contents.ByteLength() < CallRing::headerSize + capacity * (CallRing::entrySize + CallRing::completionSize)) {
+        return Nan::ThrowRangeError("The buffer is too small.");
+    }
+    auto ring = new CallRing(info[0], reinterpret_cast<char*>(contents.Data()), capacity);
+    info.GetReturnValue().Set(WrapPointer(reinterpret_cast<char*>(ring)));
+    Nan::AdjustExternalMemory(sizeof(CallRing));
+}
+
+NAN_METHOD(freeCallRing)
+{
+    if (!Buffer::HasInstance(info[0])) {
+        return Nan::ThrowTypeError("1st argument is not a Buffer.");
+    }
+
+    delete Unwrap<CallRing>(info[0]);
+    Nan::AdjustExternalMemory(-static_cast<int>(sizeof(CallRing)));
+}
+
+// register(ring, funcPtr, argCodes, resultCode): returns the index
+// of the function, or -1 if it cannot be called by the ring.
+NAN_METHOD(registerFunction)
+{
+    Nan::Utf8String argCodes(info[2]);
+    Nan::Utf8String resultCode(info[3]);
+    auto index = Unwrap<CallRing>(info[0])->Register(
+        UnwrapPointer(info[1]),
+        string(*argCodes, argCodes.length()),
+        resultCode.length() ? (*resultCode)[0] : 'v');
+    info.GetReturnValue().Set(index);
+}
+
+NAN_METHOD(notify)
+{
+    Unwrap<CallRing>(info[0])->Notify();
+}
+
+NAN_METHOD(wait)
+{
+    Unwrap<CallRing>(info[0])->Wait(info[1].As<Function>());
+}
+}
+
+NAN_MODULE_INIT(fastcall::InitCallRing)
+{
+    auto callRing = Nan::New<Object>();
+    Nan::Set(target, Nan::New<String>("callRing").ToLocalChecked(), callRing);
+    Nan::Set(callRing, Nan::New<String>("newCallRing").ToLocalChecked(), Nan::New<FunctionTemplate>(newCallRing)->GetFunction());
+    Nan::Set(callRing, Nan::New<String>("freeCallRing").ToLocalChecked(), Nan::New<FunctionTemplate>(freeCallRing)->GetFunction());
+    Nan::Set(callRing, Nan::New<String>("register").ToLocalChecked(), Nan::New<FunctionTemplate>(registerFunction)->GetFunction());
+    Nan::Set(callRing, Nan::New<String>("notify").ToLocalChecked(), Nan::New<FunctionTemplate>(notify)->GetFunction());
+    Nan::Set(callRing, Nan::New<String>("wait").ToLocalChecked(), Nan::New<FunctionTemplate>(wait)->GetFunction());
+}
@@ -0,0 +1,83 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+#include "packedcall.h"
+#include <atomic>
+#include <condition_variable>
+#include <dyncall.h>
+#include <mutex>
+#include <nan.h>
+#include <string>
+
+namespace fastcall {
+// Submission and completion rings of asynchronous calls in a
+// SharedArrayBuffer, for making lots of small calls without allocating
+// a promise and an uv_work_t per call. See lib/CallRing.js for the layout.
+// Submitted calls are consumed by a dedicated thread in order, their results
+// get published in the completion ring, JS polls them. The main thread gets
+// woken up only when JS is waiting for completions (Wait()).
+struct CallRing {
+    static const unsigned maxFunctions = 1024;
+    static const unsigned entrySize = PackedFunction::callSize;
+    static const unsigned completionSize = 16;
+    static const unsigned headerSize = 64;
+
+    // Indexes of the control block (uint32s at the beginning of the buffer).
+    enum Control {
+        sqHead,
+        sqTail,
+        cqHead,
+        cqTail,
+        sleeping,
+        waiting
+    };
+
+    CallRing(const CallRing&) = delete;
+    CallRing(const v8::Local<v8::Value>& buffer, char* memory, unsigned capacity);
+    ~CallRing();
+
+    int Register(DCpointer funcPtr, const std::string& argCodes, char resultCode);
+    void Notify();
+    void Wait(const v8::Local<v8::Function>& callback);
+
+private:
+    Nan::Global<v8::Value> buffer;
+    unsigned capacity;
+    std::atomic<uint32_t>* control;
+    char* submissions;
+    char* completions;
+    PackedFunction functions[maxFunctions];
+    std::atomic<unsigned> functionCount;
+    DCCallVM* vm;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool stopping = false;
+    uv_thread_t thread;
+    uv_async_t* handle;
+    Nan::Global<v8::Function> waiter;
+
+    void Run();
+    bool WaitForSubmissions(uint32_t head);
+    void Execute(const char* entry, char* completion);
+
+    static void ThreadMain(void* arg);
+    static void Completed(uv_async_t* handle);
+};
+
+NAN_MODULE_INIT(InitCallRing);
+}
@@ -0,0 +1,41 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+#include <cstdint>
+
+namespace fastcall {
+// Measured native execution times of an adaptive function. Lives in a Buffer
+// of the function, JS reads it, and counts its decisions in the last two.
+struct CallStats {
+    double latency; // ns, exponentially weighted moving average
+    double samples;
+    double syncCalls;
+    double asyncCalls;
+
+    void Record(uint64_t elapsed)
+    {
+        if (samples == 0) {
+            latency = static_cast<double>(elapsed);
+        }
+        else {
+            latency += (static_cast<double>(elapsed) - latency) / 8;
+        }
+        samples++;
+    }
+};
+}
@@ -21,4 +21,10 @@ limitations under the License.
 namespace fastcall {
 const unsigned SYNC_CALL_MODE = 1;
 const unsigned ASYNC_CALL_MODE = 2;
+
+const unsigned LOAD_LAZY = 1;
+const unsigned LOAD_NOW = 2;
+const unsigned LOAD_GLOBAL = 4;
+const unsigned LOAD_LOCAL = 8;
+const unsigned LOAD_DEEP_BIND = 16;
 }
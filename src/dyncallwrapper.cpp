@@ -23,6 +23,12 @@ limitations under the License.
 #include "getv8value.h"
 #include <dyncall.h>
 #include "defs.h"
+#include "executor.h"
+#include "gate.h"
+#include "packedcall.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 using namespace std;
 using namespace v8;
@@ -32,11 +38,11 @@ using namespace fastcall;
 namespace {
 
 DCCallVM* vm = nullptr;
+CallContext context;
 static v8::Local<v8::Value> workerArgs[2] = { Nan::Null(), Nan::Null() };
-uv_loop_t* defLoop = nullptr;
 
 template <typename T>
-struct CallAsyncWorker {
+struct CallAsyncWorker : AsyncCall {
     typedef T (*TCallFunc)(DCCallVM*, DCpointer);
     typedef v8::Local<v8::Value>(*TConvertFunc)(T);
 
@@ -52,7 +58,6 @@ struct CallAsyncWorker {
         , callFunc(callFunc)
         , convertFunc(convertFunc)
     {
-        work.data = this;
     }
 
     ~CallAsyncWorker()
@@ -60,10 +65,21 @@ struct CallAsyncWorker {
         dcFree(vm);
     }
 
-    void Start()
+    void Execute() override
     {
-        int r = uv_queue_work(defLoop, &work, Call, Finished);
-        assert(!r);
+        result = callFunc(vm, funcPtr);
+    }
+
+    void Complete() override
+    {
+        workerArgs[1] = convertFunc(result);
+        Nan::New(callback)->Call(Nan::Undefined(), 2, workerArgs);
+    }
+
+    void Fail(const v8::Local<v8::Value>& error) override
+    {
+        v8::Local<v8::Value> args[] = { error };
+        Nan::New(callback)->Call(Nan::Undefined(), 1, args);
     }
 
 private:
@@ -73,33 +89,6 @@ private:
     TCallFunc callFunc;
     TConvertFunc convertFunc;
     T result;
-    uv_work_t work;
-
-    static void Call(uv_work_t* req)
-    {
-        auto self = (CallAsyncWorker<T>*)req->data;
-        self->Execute();
-    }
-
-    static void Finished(uv_work_t* req, int status)
-    {
-        Nan::HandleScope scope;
-
-        auto self = (CallAsyncWorker<T>*)req->data;
-        self->HandleOKCallback();
-        delete self;
-    }
-
-    void Execute()
-    {
-        result = callFunc(vm, funcPtr);
-    }
-
-    void HandleOKCallback()
-    {
-        workerArgs[1] = convertFunc(result);
-        Nan::New(callback)->Call(Nan::Undefined(), 2, workerArgs);
-    }
 };
 
 template <typename T>
@@ -131,7 +120,132 @@ inline void CallAsync(
         callFunc,
         convertFunc);
 
-    worker->Start();
+    if (context.cancellable) {
+        info.GetReturnValue().Set(worker->Start(context));
+    }
+    else {
+        worker->Start(context);
+    }
+    context.cancellable = false;
+    context.priority = defaultPriority;
+}
+
+// Calls of a batch, executed by one or more work items (BatchCall),
+// the callback gets called when all of them have completed, or by the error
+// of the first failed one.
+struct Batch {
+    std::vector<PackedFunction> functions;
+    Nan::Global<v8::Value> calls;
+    Nan::Global<v8::Value> results;
+    const char* callData;
+    double* resultData;
+    unsigned remaining = 0;
+    bool failed = false;
+    Nan::Global<v8::Function> callback;
+};
+
+struct BatchCall : AsyncCall {
+    BatchCall(const std::shared_ptr<Batch>& batch, unsigned begin, unsigned end)
+        : batch(batch)
+        , begin(begin)
+        , end(end)
+    {
+    }
+
+    void Execute() override
+    {
+        auto callVM = dcNewCallVM(packedCallVMSize);
+        for (unsigned i = begin; i < end; i++) {
+            auto call = batch->callData + i * PackedFunction::callSize;
+            uint32_t funcIndex;
+            memcpy(&funcIndex, call, sizeof(uint32_t));
+            batch->resultData[i] = batch->functions[funcIndex].Call(callVM, call + 8);
+        }
+        dcFree(callVM);
+    }
+
+    void Complete() override
+    {
+        if (--batch->remaining == 0 && !batch->failed) {
+            Nan::New(batch->callback)->Call(Nan::Undefined(), 0, nullptr);
+        }
+    }
+
+    // The callback gets the error of the first failed work item.
+    void Fail(const v8::Local<v8::Value>& error) override
+    {
+        --batch->remaining;
+        if (!batch->failed) {
+            batch->failed = true;
+            v8::Local<v8::Value> args[] = { error };
+            Nan::New(batch->callback)->Call(Nan::Undefined(), 1, args);
+        }
+    }
+
+private:
+    std::shared_ptr<Batch> batch;
+    unsigned begin;
+    unsigned end;
+};
+
+// Synchronous calls of libraries having an executor run on its thread,
+// those of synchronized libraries take the lock in the same native frame,
+// and those of adaptive functions get measured.
+// The globals are copied, callbacks could make other calls meanwhile.
+template <typename F>
+inline void Invoke(F&& call)
+{
+    auto stats = context.stats;
+    auto start = stats ? uv_hrtime() : 0;
+    if (context.executor) {
+        if (!context.executor->RunSync(TTask(call))) {
+            return Nan::ThrowError("Synchronous calls of a queued library cannot be made by callbacks of its synchronous calls.");
+        }
+    }
+    else if (context.lock) {
+        auto lock = context.lock;
+        auto shared = context.shared;
+        lock->Lock(shared);
+        call();
+        lock->Unlock(shared);
+    }
+    else {
+        call();
+    }
+    if (stats) {
+        stats->Record(uv_hrtime() - start);
+    }
+}
+
+template <typename T>
+inline T Call(T (*callFunc)(DCCallVM*, DCpointer), DCpointer funcPtr)
+{
+    if (!context.executor && !context.lock && !context.stats) {
+        return callFunc(vm, funcPtr);
+    }
+    auto callVM = vm;
+    T result = T();
+    Invoke([&]() { result = callFunc(callVM, funcPtr); });
+    return result;
+}
+
+inline void CallVoid(DCpointer funcPtr)
+{
+    if (!context.executor && !context.lock && !context.stats) {
+        dcCallVoid(vm, funcPtr);
+        return;
+    }
+    auto callVM = vm;
+    Invoke([=]() { dcCallVoid(callVM, funcPtr); });
+}
+
+// setVM(vm, executor, lock, shared, stats, gate): the optional arguments
+// describe how the library of the next call gets synchronized, where the
+// execution time of an adaptive function's call goes, and which gate
+// admits an async call.
+inline void SetCallContext(const Nan::FunctionCallbackInfo<v8::Value>& info)
+{
+    ReadCallContext(info, 1, context);
 }
 
 NAN_METHOD(newCallVM)
@@ -149,14 +263,82 @@ NAN_METHOD(free)
 NAN_METHOD(setVM)
 {
     vm = Unwrap<DCCallVM>(info[0]);
+    SetCallContext(info);
 }
 
 NAN_METHOD(setVMAndReset)
 {
     vm = Unwrap<DCCallVM>(info[0]);
+    SetCallContext(info);
     dcReset(vm);
 }
 
+// setCallOptions(cancellable, priority): options of the next async call.
+// Cancellable calls get an id (their return value), see cancel().
+NAN_METHOD(setCallOptions)
+{
+    context.cancellable = info[0]->BooleanValue();
+    context.priority = std::min(info[1]->Uint32Value(), priorityCount - 1);
+}
+
+// Drops an async call that hasn't started executing yet, its callback
+// won't be called. Returns false if it's too late for that.
+NAN_METHOD(cancel)
+{
+    info.GetReturnValue().Set(AsyncCall::Cancel(info[0]->Uint32Value()));
+}
+
+// callBatch(functions, calls, count, results, chunkSize, callback,
+//     executor, lock, shared, stats, gate):
+// makes count packed calls (see packedcall.h) of the [ptr, argCodes,
+// resultCode] functions asynchronously, in work items of chunkSize calls,
+// writing their results into the results Float64Array.
+NAN_METHOD(callBatch)
+{
+    auto batch = std::make_shared<Batch>();
+    auto functions = info[0].As<v8::Array>();
+    for (uint32_t i = 0; i < functions->Length(); i++) {
+        auto desc = Nan::Get(functions, i).ToLocalChecked().As<v8::Array>();
+        Nan::Utf8String argCodes(Nan::Get(desc, 1).ToLocalChecked());
+        Nan::Utf8String resultCode(Nan::Get(desc, 2).ToLocalChecked());
+        PackedFunction func;
+        if (!func.Init(
+                UnwrapPointer(Nan::Get(desc, 0).ToLocalChecked()),
+                std::string(*argCodes, argCodes.length()),
+                resultCode.length() ? (*resultCode)[0] : 'v')) {
+            return Nan::ThrowTypeError("Function cannot be called in a batch.");
+        }
+        batch->functions.push_back(func);
+    }
+    auto count = info[2]->Uint32Value();
+    Nan::TypedArrayContents<double> calls(info[1]);
+    Nan::TypedArrayContents<double> results(info[3]);
+    if (calls.length() < count * (PackedFunction::callSize / sizeof(double)) || results.length() < count) {
+        return Nan::ThrowRangeError("Batch buffers are too small.");
+    }
+    for (unsigned i = 0; i < count; i++) {
+        uint32_t funcIndex;
+        memcpy(&funcIndex, reinterpret_cast<const char*>(*calls) + i * PackedFunction::callSize, sizeof(uint32_t));
+        if (funcIndex >= batch->functions.size()) {
+            return Nan::ThrowRangeError("Function index is out of range.");
+        }
+    }
+    batch->calls.Reset(info[1]);
+    batch->results.Reset(info[3]);
+    batch->callData = reinterpret_cast<const char*>(*calls);
+    batch->resultData = *results;
+    batch->callback.Reset(info[5].As<v8::Function>());
+
+    CallContext batchContext;
+    ReadCallContext(info, 6, batchContext);
+    auto chunkSize = std::max(info[4]->Uint32Value(), 1u);
+    batch->remaining = (count + chunkSize - 1) / chunkSize;
+    for (unsigned begin = 0; begin < count; begin += chunkSize) {
+        auto call = new BatchCall(batch, begin, std::min(begin + chunkSize, count));
+        call->Start(batchContext);
+    }
+}
+
 NAN_METHOD(mode)
 {
     if (vm) {
@@ -299,7 +481,7 @@ NAN_METHOD(argSizeT)
 
 NAN_METHOD(callVoid)
 {
-    dcCallVoid(vm, UnwrapPointer(info[0]));
+    CallVoid(UnwrapPointer(info[0]));
 }
 
 NAN_METHOD(callVoidAsync)
@@ -317,7 +499,7 @@ NAN_METHOD(callVoidAsync)
 
 NAN_METHOD(callBool)
 {
-    auto result = dcCallBoolean(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallBoolean, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -335,7 +517,7 @@ NAN_METHOD(callBoolAsync)
 
 NAN_METHOD(callChar)
 {
-    auto result = dcCallChar(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallChar, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -351,7 +533,7 @@ NAN_METHOD(callCharAsync)
 
 NAN_METHOD(callShort)
 {
-    auto result = dcCallShort(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallShort, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -367,7 +549,7 @@ NAN_METHOD(callShortAsync)
 
 NAN_METHOD(callInt)
 {
-    auto result = dcCallInt(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallInt, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -383,7 +565,7 @@ NAN_METHOD(callIntAsync)
 
 NAN_METHOD(callLong)
 {
-    auto result = dcCallLong(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallLong, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(MakeInt64(result));
 }
 
@@ -399,7 +581,7 @@ NAN_METHOD(callLongAsync)
 
 NAN_METHOD(callLongLong)
 {
-    auto result = dcCallLongLong(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallLongLong, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(MakeInt64(result));
 }
 
@@ -415,7 +597,7 @@ NAN_METHOD(callLongLongAsync)
 
 NAN_METHOD(callFloat)
 {
-    auto result = dcCallFloat(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallFloat, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -431,7 +613,7 @@ NAN_METHOD(callFloatAsync)
 
 NAN_METHOD(callDouble)
 {
-    auto result = dcCallDouble(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallDouble, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -447,7 +629,7 @@ NAN_METHOD(callDoubleAsync)
 
 NAN_METHOD(callPointer)
 {
-    auto result = dcCallPointer(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallPointer, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(WrapPointer(result));
 }
 
@@ -463,7 +645,7 @@ NAN_METHOD(callPointerAsync)
 
 NAN_METHOD(callInt8)
 {
-    auto result = dcCallInt8(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallInt8, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -479,7 +661,7 @@ NAN_METHOD(callInt8Async)
 
 NAN_METHOD(callInt16)
 {
-    auto result = dcCallInt16(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallInt16, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -495,7 +677,7 @@ NAN_METHOD(callInt16Async)
 
 NAN_METHOD(callInt32)
 {
-    auto result = dcCallInt32(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallInt32, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -511,7 +693,7 @@ NAN_METHOD(callInt32Async)
 
 NAN_METHOD(callInt64)
 {
-    auto result = dcCallInt64(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallInt64, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(MakeInt64(result));
 }
 
@@ -527,7 +709,7 @@ NAN_METHOD(callInt64Async)
 
 NAN_METHOD(callUInt8)
 {
-    auto result = dcCallUInt8(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallUInt8, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -543,7 +725,7 @@ NAN_METHOD(callUInt8Async)
 
 NAN_METHOD(callUInt16)
 {
-    auto result = dcCallUInt16(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallUInt16, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -559,7 +741,7 @@ NAN_METHOD(callUInt16Async)
 
 NAN_METHOD(callUInt32)
 {
-    auto result = dcCallUInt32(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallUInt32, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -575,7 +757,7 @@ NAN_METHOD(callUInt32Async)
 
 NAN_METHOD(callUInt64)
 {
-    auto result = dcCallUInt64(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallUInt64, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(MakeUint64(result));
 }
 
@@ -591,7 +773,7 @@ NAN_METHOD(callUInt64Async)
 
 NAN_METHOD(callByte)
 {
-    auto result = dcCallByte(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallByte, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -607,7 +789,7 @@ NAN_METHOD(callByteAsync)
 
 NAN_METHOD(callUChar)
 {
-    auto result = dcCallUChar(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallUChar, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -623,7 +805,7 @@ NAN_METHOD(callUCharAsync)
 
 NAN_METHOD(callUShort)
 {
-    auto result = dcCallUShort(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallUShort, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -639,7 +821,7 @@ NAN_METHOD(callUShortAsync)
 
 NAN_METHOD(callUInt)
 {
-    auto result = dcCallUInt(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallUInt, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(Nan::New(result));
 }
 
@@ -655,7 +837,7 @@ NAN_METHOD(callUIntAsync)
 
 NAN_METHOD(callULong)
 {
-    auto result = dcCallULong(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallULong, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(MakeUint64(result));
 }
 
@@ -671,7 +853,7 @@ NAN_METHOD(callULongAsync)
 
 NAN_METHOD(callULongLong)
 {
-    auto result = dcCallULongLong(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallULongLong, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(MakeUint64(result));
 }
 
@@ -687,7 +869,7 @@ NAN_METHOD(callULongLongAsync)
 
 NAN_METHOD(callSizeT)
 {
-    auto result = dcCallSizeT(vm, UnwrapPointer(info[0]));
+    auto result = Call(dcCallSizeT, UnwrapPointer(info[0]));
     info.GetReturnValue().Set(MakeUint64(result));
 }
 
@@ -704,8 +886,6 @@ NAN_METHOD(callSizeTAsync)
 
 NAN_MODULE_INIT(fastcall::InitDyncallWrapper)
 {
-    defLoop = uv_default_loop();
-
     auto dyncall = Nan::New<Object>();
     Nan::Set(target, Nan::New<String>("dyncall").ToLocalChecked(), dyncall);
     Nan::Set(dyncall, Nan::New<String>("newCallVM").ToLocalChecked(), Nan::New<FunctionTemplate>(newCallVM)->GetFunction());
@@ -714,6 +894,9 @@ NAN_MODULE_INIT(fastcall::InitDyncallWrapper)
     Nan::Set(dyncall, Nan::New<String>("reset").ToLocalChecked(), Nan::New<FunctionTemplate>(reset)->GetFunction());
     Nan::Set(dyncall, Nan::New<String>("setVM").ToLocalChecked(), Nan::New<FunctionTemplate>(setVM)->GetFunction());
     Nan::Set(dyncall, Nan::New<String>("setVMAndReset").ToLocalChecked(), Nan::New<FunctionTemplate>(setVMAndReset)->GetFunction());
+    Nan::Set(dyncall, Nan::New<String>("setCallOptions").ToLocalChecked(), Nan::New<FunctionTemplate>(setCallOptions)->GetFunction());
+    Nan::Set(dyncall, Nan::New<String>("cancel").ToLocalChecked(), Nan::New<FunctionTemplate>(cancel)->GetFunction());
+    Nan::Set(dyncall, Nan::New<String>("callBatch").ToLocalChecked(), Nan::New<FunctionTemplate>(callBatch)->GetFunction());
 
     Nan::Set(dyncall, Nan::New<String>("argBool").ToLocalChecked(), Nan::New<FunctionTemplate>(argBool)->GetFunction());
     Nan::Set(dyncall, Nan::New<String>("argChar").ToLocalChecked(), Nan::New<FunctionTemplate>(argChar)->GetFunction());
@@ -17,6 +17,10 @@ limitations under the License.
 #include "deps.h"
 #include "dynloadwrapper.h"
 #include "helpers.h"
+#include "defs.h"
+#if !defined(WIN32) && !defined(__APPLE__)
+#include <dlfcn.h>
+#endif
 
 using namespace std;
 using namespace v8;
@@ -25,12 +29,43 @@ using namespace fastcall;
 
 namespace {
 
+#if !defined(WIN32) && !defined(__APPLE__)
+DLLib* OpenLibrary(const char* path, unsigned flags)
+{
+    if (!flags) {
+        return dlLoadLibrary(path);
+    }
+    // Defaults are the same as dlLoadLibrary's: RTLD_NOW | RTLD_GLOBAL.
+    int mode = (flags & LOAD_LAZY) ? RTLD_LAZY : RTLD_NOW;
+    mode |= (flags & LOAD_LOCAL) ? RTLD_LOCAL : RTLD_GLOBAL;
+#ifdef RTLD_DEEPBIND
+    if (flags & LOAD_DEEP_BIND) {
+        mode |= RTLD_DEEPBIND;
+    }
+#endif
+    // DLLib* is the dlopen handle itself on these platforms.
+    return (DLLib*)dlopen(path, mode);
+}
+#else
+DLLib* OpenLibrary(const char* path, unsigned flags)
+{
+    // dynload has its own handle representation here, load flags are not supported.
+    return dlLoadLibrary(path);
+}
+#endif
+
+string LoadErrorMessage(const string& path)
+{
+    return string("Cannot load library or library not found: ") + path;
+}
+
 NAN_METHOD(loadLibrary)
 {
-    char* str = *Nan::Utf8String(info[0]);
-    DLLib* pLib = dlLoadLibrary((*str) ? str : nullptr);
+    Nan::Utf8String str(info[0]);
+    unsigned flags = info[1]->IsNumber() ? info[1]->Uint32Value() : 0;
+    DLLib* pLib = OpenLibrary((**str) ? *str : nullptr, flags);
     if (!pLib) {
-        return Nan::ThrowTypeError((string("Cannot load library or library not found: ") + str).c_str());
+        return Nan::ThrowTypeError(LoadErrorMessage(*str).c_str());
     }
     return info.GetReturnValue().Set(WrapPointer(pLib));
 }
@@ -58,6 +93,205 @@ NAN_METHOD(findSymbol)
     }
     return info.GetReturnValue().Set(WrapPointer(pF));
 }
+
+v8::Local<v8::Array> MakePointerArray(const vector<void*>& ptrs)
+{
+    Nan::EscapableHandleScope scope;
+
+    auto result = Nan::New<Array>((int)ptrs.size());
+    for (size_t i = 0; i < ptrs.size(); i++) {
+        if (ptrs[i]) {
+            Nan::Set(result, (uint32_t)i, WrapPointer(ptrs[i]));
+        }
+        else {
+            Nan::Set(result, (uint32_t)i, Nan::Null());
+        }
+    }
+    return scope.Escape(result);
+}
+
+vector<string> GetNames(const v8::Local<v8::Array>& arr)
+{
+    Nan::HandleScope scope;
+
+    vector<string> names;
+    names.reserve(arr->Length());
+    for (uint32_t i = 0; i < arr->Length(); i++) {
+        names.emplace_back(*Nan::Utf8String(Nan::Get(arr, i).ToLocalChecked()));
+    }
+    return names;
+}
+
+void ResolveAll(DLLib* pLib, const vector<string>& names, vector<void*>& ptrs)
+{
+    ptrs.resize(names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+        ptrs[i] = dlFindSymbol(pLib, names[i].c_str());
+    }
+}
+
+struct ResolveAllWorker {
+    ResolveAllWorker(Nan::Global<v8::Function>&& callback, DLLib* pLib, vector<string>&& names)
+        : callback(std::move(callback))
+        , pLib(pLib)
+        , names(std::move(names))
+    {
+        work.data = this;
+    }
+
+    void Start()
+    {
+        int r = uv_queue_work(uv_default_loop(), &work, Call, Finished);
+        assert(!r);
+    }
+
+private:
+    Nan::Global<v8::Function> callback;
+    DLLib* pLib;
+    vector<string> names;
+    vector<void*> ptrs;
+    uv_work_t work;
+
+    static void Call(uv_work_t* req)
+    {
+        auto self = (ResolveAllWorker*)req->data;
+        ResolveAll(self->pLib, self->names, self->ptrs);
+    }
+
+    static void Finished(uv_work_t* req, int status)
+    {
+        Nan::HandleScope scope;
+
+        auto self = (ResolveAllWorker*)req->data;
+        v8::Local<v8::Value> args[] = { Nan::Null(), MakePointerArray(self->ptrs) };
+        Nan::New(self->callback)->Call(Nan::Undefined(), 2, args);
+        delete self;
+    }
+};
+
+struct LoadLibraryWorker {
+    LoadLibraryWorker(Nan::Global<v8::Function>&& callback, string&& path, unsigned flags, vector<string>&& names)
+        : callback(std::move(callback))
+        , path(std::move(path))
+        , flags(flags)
+        , names(std::move(names))
+        , pLib(nullptr)
+    {
+        work.data = this;
+    }
+
+    void Start()
+    {
+        int r = uv_queue_work(uv_default_loop(), &work, Call, Finished);
+        assert(!r);
+    }
+
+private:
+    Nan::Global<v8::Function> callback;
+    string path;
+    unsigned flags;
+    vector<string> names;
+    DLLib* pLib;
+    vector<void*> ptrs;
+    uv_work_t work;
+
+    static void Call(uv_work_t* req)
+    {
+        auto self = (LoadLibraryWorker*)req->data;
+        self->pLib = OpenLibrary(self->path.empty() ? nullptr : self->path.c_str(), self->flags);
+        if (self->pLib) {
+            ResolveAll(self->pLib, self->names, self->ptrs);
+        }
+    }
+
+    static void Finished(uv_work_t* req, int status)
+    {
+        Nan::HandleScope scope;
+
+        auto self = (LoadLibraryWorker*)req->data;
+        if (self->pLib) {
+            v8::Local<v8::Value> args[] = { Nan::Null(), WrapPointer(self->pLib), MakePointerArray(self->ptrs) };
+            Nan::New(self->callback)->Call(Nan::Undefined(), 3, args);
+        }
+        else {
+            v8::Local<v8::Value> args[] = { Nan::TypeError(LoadErrorMessage(self->path).c_str()) };
+            Nan::New(self->callback)->Call(Nan::Undefined(), 1, args);
+        }
+        delete self;
+    }
+};
+
+NAN_METHOD(loadLibraryAsync)
+{
+    unsigned flags = info[1]->IsNumber() ? info[1]->Uint32Value() : 0;
+    if (!info[2]->IsArray()) {
+        return Nan::ThrowTypeError("Third argument is not an array.");
+    }
+    if (!info[3]->IsFunction()) {
+        return Nan::ThrowTypeError("Fourth argument is not a function.");
+    }
+    auto worker = new LoadLibraryWorker(
+        Nan::Global<v8::Function>(info[3].As<v8::Function>()),
+        string(*Nan::Utf8String(info[0])),
+        flags,
+        GetNames(info[2].As<Array>()));
+    worker->Start();
+    return info.GetReturnValue().SetUndefined();
+}
+
+NAN_METHOD(resolveAll)
+{
+    DLLib* pLib = UnwrapPointer<DLLib>(info[0]);
+    if (!pLib) {
+        return Nan::ThrowTypeError("First argument's value is null or not a pointer.");
+    }
+    if (!info[1]->IsArray()) {
+        return Nan::ThrowTypeError("Second argument is not an array.");
+    }
+    vector<void*> ptrs;
+    ResolveAll(pLib, GetNames(info[1].As<Array>()), ptrs);
+    return info.GetReturnValue().Set(MakePointerArray(ptrs));
+}
+
+NAN_METHOD(resolveAllAsync)
+{
+    DLLib* pLib = UnwrapPointer<DLLib>(info[0]);
+    if (!pLib) {
+        return Nan::ThrowTypeError("First argument's value is null or not a pointer.");
+    }
+    if (!info[1]->IsArray()) {
+        return Nan::ThrowTypeError("Second argument is not an array.");
+    }
+    if (!info[2]->IsFunction()) {
+        return Nan::ThrowTypeError("Third argument is not a function.");
+    }
+    auto worker = new ResolveAllWorker(
+        Nan::Global<v8::Function>(info[2].As<v8::Function>()),
+        pLib,
+        GetNames(info[1].As<Array>()));
+    worker->Start();
+    return info.GetReturnValue().SetUndefined();
+}
+
+NAN_METHOD(listSymbols)
+{
+    Nan::Utf8String path(info[0]);
+    DLSyms* pSyms = dlSymsInit(*path);
+    if (!pSyms) {
+        return info.GetReturnValue().Set(Nan::Null());
+    }
+    auto result = Nan::New<Array>();
+    uint32_t idx = 0;
+    int count = dlSymsCount(pSyms);
+    for (int i = 0; i < count; i++) {
+        const char* name = dlSymsName(pSyms, i);
+        if (name && *name) {
+            Nan::Set(result, idx++, Nan::New<String>(name).ToLocalChecked());
+        }
+    }
+    dlSymsCleanup(pSyms);
+    return info.GetReturnValue().Set(result);
+}
 }
 
 NAN_MODULE_INIT(fastcall::InitDynloadWrapper)
@@ -65,6 +299,10 @@ NAN_MODULE_INIT(fastcall::InitDynloadWrapper)
     auto dynload = Nan::New<Object>();
     Nan::Set(target, Nan::New<String>("dynload").ToLocalChecked(), dynload);
     Nan::Set(dynload, Nan::New<String>("loadLibrary").ToLocalChecked(), Nan::New<FunctionTemplate>(loadLibrary)->GetFunction());
+    Nan::Set(dynload, Nan::New<String>("loadLibraryAsync").ToLocalChecked(), Nan::New<FunctionTemplate>(loadLibraryAsync)->GetFunction());
     Nan::Set(dynload, Nan::New<String>("freeLibrary").ToLocalChecked(), Nan::New<FunctionTemplate>(freeLibrary)->GetFunction());
     Nan::Set(dynload, Nan::New<String>("findSymbol").ToLocalChecked(), Nan::New<FunctionTemplate>(findSymbol)->GetFunction());
+    Nan::Set(dynload, Nan::New<String>("resolveAll").ToLocalChecked(), Nan::New<FunctionTemplate>(resolveAll)->GetFunction());
+    Nan::Set(dynload, Nan::New<String>("resolveAllAsync").ToLocalChecked(), Nan::New<FunctionTemplate>(resolveAllAsync)->GetFunction());
+    Nan::Set(dynload, Nan::New<String>("listSymbols").ToLocalChecked(), Nan::New<FunctionTemplate>(listSymbols)->GetFunction());
 }
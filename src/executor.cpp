@@ -0,0 +1,466 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "executor.h"
+#include "deps.h"
+#include "gate.h"
+#include "helpers.h"
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+using namespace v8;
+using namespace node;
+using namespace fastcall;
+
+namespace {
+thread_local Executor* currentExecutor = nullptr;
+
+// Cancellable calls in progress by their ids, used on the main thread only.
+unordered_map<uint32_t, AsyncCall*> cancellableCalls;
+uint32_t nextCallId = 0;
+}
+
+void fastcall::ReadCallContext(const Nan::FunctionCallbackInfo<v8::Value>& info, int first, CallContext& context)
+{
+    auto length = info.Length();
+    auto has = [&](int index) { return length > first + index && !info[first + index]->IsNull(); };
+    context.executor = has(0) ? Unwrap<Executor>(info[first]) : nullptr;
+    context.lock = has(1) ? Unwrap<LibraryLock>(info[first + 1]) : nullptr;
+    context.shared = has(2) && info[first + 2]->BooleanValue();
+    context.stats = has(3) ? Unwrap<CallStats>(info[first + 3]) : nullptr;
+    context.gate = has(4) ? Unwrap<Gate>(info[first + 4]) : nullptr;
+}
+
+AsyncCall::AsyncCall()
+{
+    work.data = this;
+}
+
+AsyncCall::~AsyncCall()
+{
+    if (context.lock) {
+        context.lock->Unref();
+    }
+}
+
+uint32_t AsyncCall::Start(const CallContext& context)
+{
+    this->context = context;
+    if (context.lock) {
+        // the lock outlives its JS wrapper while the call is pending
+        context.lock->Ref();
+    }
+    if (context.cancellable) {
+        if (++nextCallId == 0) {
+            ++nextCallId;
+        }
+        id = nextCallId;
+        cancellableCalls[id] = this;
+    }
+    if (context.gate) {
+        context.gate->Submit(this);
+    }
+    else {
+        Dispatch();
+    }
+    return id;
+}
+
+void AsyncCall::Dispatch()
+{
+    dispatched = true;
+    if (context.lock && !context.lock->Acquire(this, context.shared)) {
+        // parked, the lock dispatches it once it's granted
+        return;
+    }
+    DispatchLocked();
+}
+
+void AsyncCall::DispatchLocked()
+{
+    locked = context.lock != nullptr;
+    if (context.executor) {
+        context.executor->Push(this);
+    }
+    else {
+        int r = uv_queue_work(uv_default_loop(), &work, Call, Finished);
+        assert(!r);
+    }
+}
+
+void AsyncCall::Run()
+{
+    auto stats = context.stats;
+    auto start = stats ? uv_hrtime() : 0;
+    Execute();
+    if (context.lock) {
+        context.lock->Unlock(context.shared);
+    }
+    if (stats) {
+        elapsed = uv_hrtime() - start;
+    }
+}
+
+void AsyncCall::Finish()
+{
+    if (id) {
+        cancellableCalls.erase(id);
+    }
+    if (context.gate) {
+        context.gate->Release();
+    }
+    if (context.stats) {
+        context.stats->Record(elapsed);
+    }
+    Complete();
+}
+
+// Drops a call that hasn't started executing, it gets failed by an error.
+// Deleted by the caller.
+void AsyncCall::Abort(const char* message)
+{
+    if (id) {
+        cancellableCalls.erase(id);
+        id = 0;
+    }
+    if (locked) {
+        context.lock->Unlock(context.shared);
+    }
+    if (dispatched && context.gate) {
+        context.gate->Release();
+    }
+    Fail(Nan::Error(message));
+}
+
+bool AsyncCall::Cancel(uint32_t id)
+{
+    auto it = cancellableCalls.find(id);
+    if (it == cancellableCalls.end()) {
+        // completed already
+        return false;
+    }
+    auto self = it->second;
+    auto& context = self->context;
+    if (!self->dispatched) {
+        // waiting for admission
+        context.gate->Remove(self);
+        cancellableCalls.erase(it);
+        delete self;
+        return true;
+    }
+    if (!self->locked && context.lock) {
+        // parked by the lock
+        if (!context.lock->Remove(self)) {
+            return false;
+        }
+        cancellableCalls.erase(it);
+        if (context.gate) {
+            context.gate->Release();
+        }
+        delete self;
+        return true;
+    }
+    if (context.executor) {
+        if (!context.executor->Remove(self)) {
+            return false;
+        }
+        cancellableCalls.erase(it);
+        if (self->locked) {
+            context.lock->Unlock(context.shared);
+        }
+        if (context.gate) {
+            context.gate->Release();
+        }
+        delete self;
+        return true;
+    }
+    if (uv_cancel((uv_req_t*)&self->work)) {
+        // running
+        return false;
+    }
+    // Finished() gets called with UV_ECANCELED
+    cancellableCalls.erase(it);
+    self->id = 0;
+    if (self->locked) {
+        context.lock->Unlock(context.shared);
+    }
+    if (context.gate) {
+        context.gate->Release();
+    }
+    return true;
+}
+
+void AsyncCall::Call(uv_work_t* req)
+{
+    auto self = (AsyncCall*)req->data;
+    self->Run();
+}
+
+void AsyncCall::Finished(uv_work_t* req, int status)
+{
+    Nan::HandleScope scope;
+
+    auto self = (AsyncCall*)req->data;
+    if (status != UV_ECANCELED) {
+        self->Finish();
+    }
+    delete self;
+}
+
+Executor::Executor()
+    : handle(new uv_async_t)
+{
+    int r = uv_async_init(uv_default_loop(), handle, CallsCompleted);
+    assert(!r);
+    handle->data = static_cast<void*>(this);
+    uv_unref((uv_handle_t*)handle);
+    r = uv_thread_create(&thread, ThreadMain, this);
+    assert(!r);
+}
+
+Executor::~Executor()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cond.notify_one();
+
+    // The call in progress could invoke callbacks.
+    {
+        unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            waiterCond.wait(lock, [this]() { return stopped || !waiterTasks.empty(); });
+            RunWaiterTasks(lock);
+            if (stopped) {
+                break;
+            }
+        }
+    }
+    uv_thread_join(&thread);
+
+    ProcessCompleted();
+
+    // Aborting a call could dispatch the next one of its gate.
+    for (;;) {
+        AsyncCall* call;
+        {
+            lock_guard<std::mutex> lock(mutex);
+            call = PopCall();
+        }
+        if (!call) {
+            break;
+        }
+        Nan::HandleScope scope;
+
+        call->Abort("Library has been released.");
+        delete call;
+        CallDone();
+    }
+    uv_close((uv_handle_t*)handle, DeleteUVAsyncHandle);
+}
+
+void Executor::Push(AsyncCall* call)
+{
+    if (pending++ == 0) {
+        uv_ref((uv_handle_t*)handle);
+    }
+    {
+        lock_guard<std::mutex> lock(mutex);
+        calls[call->GetPriority()].push_back(call);
+    }
+    cond.notify_one();
+}
+
+bool Executor::RunSync(TTask&& task)
+{
+    if (syncRunning) {
+        // the thread is blocked by the callback calling us
+        return false;
+    }
+    syncRunning = true;
+    unique_lock<std::mutex> lock(mutex);
+    syncTask = &task;
+    syncDone = false;
+    cond.notify_one();
+    for (;;) {
+        waiterCond.wait(lock, [this]() { return syncDone || !waiterTasks.empty(); });
+        RunWaiterTasks(lock);
+        if (syncDone) {
+            syncRunning = false;
+            return true;
+        }
+    }
+}
+
+bool Executor::Remove(AsyncCall* call)
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        auto& lane = calls[call->GetPriority()];
+        auto it = find(lane.begin(), lane.end(), call);
+        if (it == lane.end()) {
+            return false;
+        }
+        lane.erase(it);
+    }
+    CallDone();
+    return true;
+}
+
+// The main thread is either waiting for the executor (a synchronous call,
+// or destruction), or runs the task by the completion handle.
+bool Executor::DoInWaitingThread(TTask& task)
+{
+    auto self = currentExecutor;
+    if (!self) {
+        return false;
+    }
+    {
+        lock_guard<std::mutex> lock(self->mutex);
+        self->waiterTasks.push_back(std::move(task));
+        uv_async_send(self->handle);
+    }
+    self->waiterCond.notify_one();
+    return true;
+}
+
+void Executor::Run()
+{
+    unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        AsyncCall* call = nullptr;
+        // the calls not started yet get aborted on stop
+        cond.wait(lock, [this, &call]() { return syncTask || stopping || (call = PopCall()); });
+        if (syncTask) {
+            auto task = syncTask;
+            lock.unlock();
+            (*task)();
+            lock.lock();
+            syncTask = nullptr;
+            syncDone = true;
+            waiterCond.notify_one();
+        }
+        else if (call) {
+            lock.unlock();
+            call->Run();
+            lock.lock();
+            completed.push_back(call);
+            uv_async_send(handle);
+        }
+        else {
+            stopped = true;
+            waiterCond.notify_one();
+            return;
+        }
+    }
+}
+
+AsyncCall* Executor::PopCall()
+{
+    for (auto& lane : calls) {
+        if (!lane.empty()) {
+            auto call = lane.front();
+            lane.pop_front();
+            return call;
+        }
+    }
+    return nullptr;
+}
+
+void Executor::RunWaiterTasks(unique_lock<std::mutex>& lock)
+{
+    while (!waiterTasks.empty()) {
+        auto waiterTask = std::move(waiterTasks.front());
+        waiterTasks.pop_front();
+        lock.unlock();
+        waiterTask();
+        lock.lock();
+    }
+}
+
+void Executor::ProcessCompleted()
+{
+    deque<AsyncCall*> done;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        done.swap(completed);
+    }
+    for (auto call : done) {
+        Nan::HandleScope scope;
+
+        call->Finish();
+        delete call;
+        CallDone();
+    }
+}
+
+void Executor::CallDone()
+{
+    if (--pending == 0) {
+        uv_unref((uv_handle_t*)handle);
+    }
+}
+
+void Executor::ThreadMain(void* arg)
+{
+    currentExecutor = static_cast<Executor*>(arg);
+    currentExecutor->Run();
+}
+
+void Executor::CallsCompleted(uv_async_t* handle)
+{
+    auto self = static_cast<Executor*>(handle->data);
+    {
+        unique_lock<std::mutex> lock(self->mutex);
+        self->RunWaiterTasks(lock);
+    }
+    self->ProcessCompleted();
+}
+
+namespace {
+NAN_METHOD(newExecutor)
+{
+    info.GetReturnValue().Set(WrapPointer(reinterpret_cast<char*>(new Executor())));
+    Nan::AdjustExternalMemory(sizeof(Executor));
+}
+
+NAN_METHOD(freeExecutor)
+{
+    if (!Buffer::HasInstance(info[0])) {
+        return Nan::ThrowTypeError("1st argument is not a Buffer.");
+    }
+
+    delete Unwrap<Executor>(info[0]);
+    Nan::AdjustExternalMemory(-static_cast<int>(sizeof(Executor)));
+}
+
+NAN_METHOD(isIdle)
+{
+    info.GetReturnValue().Set(Unwrap<Executor>(info[0])->IsIdle());
+}
+}
+
+NAN_MODULE_INIT(fastcall::InitExecutor)
+{
+    auto executor = Nan::New<Object>();
+    Nan::Set(target, Nan::New<String>("executor").ToLocalChecked(), executor);
+    Nan::Set(executor, Nan::New<String>("newExecutor").ToLocalChecked(), Nan::New<FunctionTemplate>(newExecutor)->GetFunction());
+    Nan::Set(executor, Nan::New<String>("freeExecutor").ToLocalChecked(), Nan::New<FunctionTemplate>(freeExecutor)->GetFunction());
+    Nan::Set(executor, Nan::New<String>("isIdle").ToLocalChecked(), Nan::New<FunctionTemplate>(isIdle)->GetFunction());
+}
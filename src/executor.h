@@ -0,0 +1,159 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+#include "callstats.h"
+#include "librarylock.h"
+#include "loop.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <nan.h>
+
+namespace fastcall {
+struct Executor;
+struct Gate;
+
+// Priority lanes of asynchronous calls, lower ones go first.
+const unsigned priorityCount = 3;
+const unsigned defaultPriority = 1;
+
+// How the next call gets made, see setVM() and setCallOptions().
+struct CallContext {
+    Executor* executor = nullptr;
+    LibraryLock* lock = nullptr;
+    bool shared = false;
+    CallStats* stats = nullptr;
+    Gate* gate = nullptr;
+    bool cancellable = false;
+    unsigned priority = defaultPriority;
+};
+
+// Reads the optional (executor, lock, shared, stats, gate) arguments
+// of a native method from first on.
+void ReadCallContext(const Nan::FunctionCallbackInfo<v8::Value>& info, int first, CallContext& context);
+
+// An asynchronous native call, executed either by the thread pool of libuv,
+// or by the executor of its library. Completed on the main thread.
+// The lock of a synchronized library is acquired before dispatching,
+// contended calls wait parked in the lock's queue without occupying
+// threads, and it's released by the executing thread. The execution
+// time of calls of adaptive functions gets recorded on completion.
+// Calls of gated functions wait for their gate's admission before getting
+// dispatched. Cancellable calls get an id, by that they could be dropped
+// until their execution begins. Calls dropped by the release of their
+// library get failed by an error.
+struct AsyncCall {
+    AsyncCall();
+    virtual ~AsyncCall();
+
+    uint32_t Start(const CallContext& context);
+    void Dispatch();
+    void DispatchLocked();
+    void Run();
+    void Finish();
+    void Abort(const char* message);
+
+    unsigned GetPriority() const
+    {
+        return context.priority;
+    }
+
+    Gate* GetGate() const
+    {
+        return context.gate;
+    }
+
+    bool IsShared() const
+    {
+        return context.shared;
+    }
+
+    virtual void Execute() = 0;
+    virtual void Complete() = 0;
+    virtual void Fail(const v8::Local<v8::Value>& error) = 0;
+
+    static bool Cancel(uint32_t id);
+
+private:
+    uv_work_t work;
+    CallContext context;
+    uint32_t id = 0;
+    bool dispatched = false;
+    bool locked = false;
+    uint64_t elapsed = 0;
+
+    static void Call(uv_work_t* req);
+    static void Finished(uv_work_t* req, int status);
+};
+
+// A dedicated thread of a library (syncMode.queue) running its calls
+// in FIFO order per priority lane. Asynchronous calls get completed on the main thread by
+// an uv_async_t, that keeps the event loop alive while calls are pending.
+// Synchronous calls block the main thread until they're done, and it runs
+// the callbacks invoked by them meanwhile. Callbacks invoked by asynchronous
+// calls run on the main thread by the same handle as completions.
+// On destruction the calls not started yet get aborted, and the main thread
+// runs the callbacks of the call in progress until it's done.
+struct Executor {
+    Executor(const Executor&) = delete;
+    Executor();
+    ~Executor();
+
+    void Push(AsyncCall* call);
+    bool Remove(AsyncCall* call);
+    // Returns false if a synchronous call is in progress already, that is
+    // when a callback invoked by it calls the library synchronously again.
+    bool RunSync(TTask&& task);
+
+    bool IsIdle() const
+    {
+        return pending == 0;
+    }
+
+    // Runs task on the main thread if the current thread is an executor,
+    // returns false otherwise.
+    static bool DoInWaitingThread(TTask& task);
+
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::condition_variable waiterCond;
+    std::deque<AsyncCall*> calls[priorityCount];
+    std::deque<AsyncCall*> completed;
+    std::deque<TTask> waiterTasks;
+    TTask* syncTask = nullptr;
+    bool syncDone = false;
+    bool syncRunning = false; // used on the main thread only
+    bool stopping = false;
+    bool stopped = false;
+    unsigned pending = 0;
+    uv_thread_t thread;
+    uv_async_t* handle;
+
+    void Run();
+    AsyncCall* PopCall();
+    void RunWaiterTasks(std::unique_lock<std::mutex>& lock);
+    void ProcessCompleted();
+    void CallDone();
+
+    static void ThreadMain(void* arg);
+    static void CallsCompleted(uv_async_t* handle);
+};
+
+NAN_MODULE_INIT(InitExecutor);
+}
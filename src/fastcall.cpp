@@ -18,9 +18,15 @@ limitations under the License.
 #include "dynloadwrapper.h"
 #include "dyncallwrapper.h"
 #include "dyncallbackwrapper.h"
-#include "mutex.h"
 #include "weak.h"
 #include "statics.h"
+#include "marshal.h"
+#include "arena.h"
+#include "executor.h"
+#include "librarylock.h"
+#include "gate.h"
+#include "callring.h"
+#include "callplan.h"
 
 using namespace v8;
 using namespace fastcall;
@@ -31,8 +37,14 @@ NAN_MODULE_INIT(InitAll)
     InitDynloadWrapper(target);
     InitDyncallWrapper(target);
     InitCallbackWrapper(target);
-    InitMutex(target);
     InitWeak(target);
+    InitMarshal(target);
+    InitArena(target);
+    InitExecutor(target);
+    InitLibraryLock(target);
+    InitGate(target);
+    InitCallRing(target);
+    InitCallPlan(target);
     InitStatics(target);
 }
 
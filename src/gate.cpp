@@ -0,0 +1,181 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "gate.h"
+#include "deps.h"
+#include "helpers.h"
+#include <algorithm>
+
+using namespace std;
+using namespace v8;
+using namespace node;
+using namespace fastcall;
+
+void Gate::Submit(AsyncCall* call)
+{
+    if (!limit || running < limit) {
+        Admit(call);
+    }
+    else {
+        lanes[call->GetPriority()].push_back(call);
+        queued++;
+    }
+}
+
+// Drops a call that hasn't been dispatched yet.
+void Gate::Remove(AsyncCall* call)
+{
+    auto& lane = lanes[call->GetPriority()];
+    auto it = find(lane.begin(), lane.end(), call);
+    if (it != lane.end()) {
+        lane.erase(it);
+        queued--;
+        DeleteIfUnused();
+        return;
+    }
+
+    // admitted already, waiting for the parent
+    assert(parent);
+    parent->Remove(call);
+    running--;
+    Pump();
+    DeleteIfUnused();
+}
+
+// A call admitted by this gate is done (or has been cancelled).
+// The waiting calls get forwarded to the parent before it's released,
+// so they don't get overtaken by the lower priority calls of its other gates.
+void Gate::Release()
+{
+    assert(running);
+    running--;
+    Pump();
+    auto p = parent;
+    DeleteIfUnused();
+    if (p) {
+        p->Release();
+    }
+}
+
+// Fails the calls waiting for admission, those waiting in a parent have
+// been admitted by the gates of their functions already.
+void Gate::Close(const char* message)
+{
+    for (auto& lane : lanes) {
+        while (!lane.empty()) {
+            Nan::HandleScope scope;
+
+            auto call = lane.front();
+            lane.pop_front();
+            queued--;
+            for (auto gate = call->GetGate(); gate != this;) {
+                auto next = gate->parent;
+                gate->running--;
+                gate->DeleteIfUnused();
+                gate = next;
+            }
+            call->Abort(message);
+            delete call;
+        }
+    }
+    DeleteIfUnused();
+}
+
+void Gate::Free()
+{
+    freeing = true;
+    DeleteIfUnused();
+}
+
+void Gate::GetState(unsigned& running, unsigned& queued) const
+{
+    running = this->running;
+    queued = this->queued;
+}
+
+void Gate::Admit(AsyncCall* call)
+{
+    running++;
+    if (parent) {
+        parent->Submit(call);
+    }
+    else {
+        call->Dispatch();
+    }
+}
+
+void Gate::Pump()
+{
+    while (queued && (!limit || running < limit)) {
+        for (auto& lane : lanes) {
+            if (!lane.empty()) {
+                auto call = lane.front();
+                lane.pop_front();
+                queued--;
+                Admit(call);
+                break;
+            }
+        }
+    }
+}
+
+void Gate::DeleteIfUnused()
+{
+    if (freeing && !running && !queued && !children) {
+        auto p = parent;
+        delete this;
+        if (p) {
+            p->children--;
+            p->DeleteIfUnused();
+        }
+    }
+}
+
+namespace {
+NAN_METHOD(newGate)
+{
+    auto parent = info.Length() > 1 && !info[1]->IsNull() ? Unwrap<Gate>(info[1]) : nullptr;
+    auto gate = new Gate(info[0]->Uint32Value(), parent);
+    info.GetReturnValue().Set(Wrap<Gate>(gate, [](char* data, void* hint) {
+        reinterpret_cast<Gate*>(data)->Free();
+    }));
+}
+
+NAN_METHOD(closeGate)
+{
+    Unwrap<Gate>(info[0])->Close("Library has been released.");
+}
+
+NAN_METHOD(state)
+{
+    unsigned running, queued;
+    Unwrap<Gate>(info[0])->GetState(running, queued);
+    auto result = Nan::New<Object>();
+    SetValue(result, "running", Nan::New(running));
+    SetValue(result, "queued", Nan::New(queued));
+    info.GetReturnValue().Set(result);
+}
+}
+
+NAN_MODULE_INIT(fastcall::InitGate)
+{
+    auto gate = Nan::New<Object>();
+    Nan::Set(target, Nan::New<String>("gate").ToLocalChecked(), gate);
+    Nan::Set(gate, Nan::New<String>("newGate").ToLocalChecked(), Nan::New<FunctionTemplate>(newGate)->GetFunction());
+    Nan::Set(gate, Nan::New<String>("close").ToLocalChecked(), Nan::New<FunctionTemplate>(closeGate)->GetFunction());
+    Nan::Set(gate, Nan::New<String>("state").ToLocalChecked(), Nan::New<FunctionTemplate>(state)->GetFunction());
+}
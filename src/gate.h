@@ -0,0 +1,65 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+#include "executor.h"
+#include <deque>
+#include <nan.h>
+
+namespace fastcall {
+// Admission control of asynchronous calls: at most limit calls of a gate
+// (0 means unlimited) are dispatched at once, the rest wait in priority
+// lanes. Gates of functions having their own limit are chained to
+// the gate of their library, calls admitted by them still have to be
+// admitted by the parent. Used on the main thread only.
+// Freed by the garbage collector, but kept alive until its calls are done,
+// and a parent until its children are freed.
+// Closed on the release of the library, that fails the waiting calls.
+struct Gate {
+    Gate(const Gate&) = delete;
+    Gate(unsigned limit, Gate* parent)
+        : limit(limit)
+        , parent(parent)
+    {
+        if (parent) {
+            parent->children++;
+        }
+    }
+
+    void Submit(AsyncCall* call);
+    void Remove(AsyncCall* call);
+    void Release();
+    void Close(const char* message);
+    void Free();
+    void GetState(unsigned& running, unsigned& queued) const;
+
+private:
+    unsigned limit;
+    Gate* parent;
+    std::deque<AsyncCall*> lanes[priorityCount];
+    unsigned running = 0;
+    unsigned queued = 0;
+    unsigned children = 0;
+    bool freeing = false;
+
+    void Admit(AsyncCall* call);
+    void Pump();
+    void DeleteIfUnused();
+};
+
+NAN_MODULE_INIT(InitGate);
+}
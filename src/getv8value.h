@@ -22,6 +22,16 @@ limitations under the License.
 #include "int64.h"
 
 namespace fastcall {
+template <typename T>
+inline void* GetArrayBufferData(v8::Local<T> ab)
+{
+#if V8_MAJOR_VERSION > 7 || (V8_MAJOR_VERSION == 7 && V8_MINOR_VERSION >= 9)
+    return ab->GetBackingStore()->Data();
+#else
+    return ab->GetContents().Data();
+#endif
+}
+
 inline void* GetPointer(v8::Local<v8::Value> val)
 {
     using namespace v8;
@@ -34,6 +44,21 @@ inline void* GetPointer(v8::Local<v8::Value> val)
     if (val->IsNull()) {
         return nullptr;
     }
+    // TypedArrays and DataViews point to their first element (byteOffset honoured),
+    // array buffers to their beginning. No copies are made, so the memory is
+    // only valid while the JS object is alive.
+    if (val->IsArrayBufferView()) {
+        Nan::TypedArrayContents<uint8_t> contents(val);
+        return reinterpret_cast<void*>(*contents);
+    }
+    if (val->IsArrayBuffer()) {
+        return GetArrayBufferData(val.As<ArrayBuffer>());
+    }
+#if V8_MAJOR_VERSION >= 5
+    if (val->IsSharedArrayBuffer()) {
+        return GetArrayBufferData(val.As<SharedArrayBuffer>());
+    }
+#endif
     throw std::logic_error("Argument is not a pointer or null.");
 }
 
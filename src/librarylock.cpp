@@ -0,0 +1,321 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "librarylock.h"
+#include "deps.h"
+#include "executor.h"
+#include "helpers.h"
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+using namespace v8;
+using namespace node;
+using namespace fastcall;
+
+LibraryLock::LibraryLock()
+    : queued(0)
+    , spinLimit(minSpins)
+    , handle(new uv_async_t)
+{
+    int r = uv_async_init(uv_default_loop(), handle, Granted);
+    assert(!r);
+    handle->data = static_cast<void*>(this);
+    uv_unref((uv_handle_t*)handle);
+}
+
+LibraryLock::~LibraryLock()
+{
+    uv_close((uv_handle_t*)handle, DeleteUVAsyncHandle);
+    Nan::AdjustExternalMemory(-static_cast<int>(sizeof(LibraryLock)));
+}
+
+void LibraryLock::Lock(bool shared)
+{
+    unsigned limit = spinLimit;
+    for (unsigned i = 0; i < limit; i++) {
+        if (queued) {
+            // TryLock() cannot succeed before them
+            break;
+        }
+        if (TryLock(shared)) {
+            if (i && limit < maxSpins) {
+                spinLimit = limit * 2;
+            }
+            return;
+        }
+        this_thread::yield();
+    }
+    if (limit > minSpins && !queued) {
+        spinLimit = limit / 2;
+    }
+
+    unique_lock<std::mutex> lock(mutex);
+    bool isGranted = false;
+    waiters.push_back(Waiter{ shared, nullptr, &isGranted });
+    queued = waiters.size();
+    Pump();
+    for (;;) {
+        cond.wait(lock, [&]() { return isGranted || !granted.empty(); });
+        if (!granted.empty()) {
+            // calls ahead of us, they need this thread to get dispatched
+            lock.unlock();
+            DispatchGranted();
+            lock.lock();
+        }
+        if (isGranted) {
+            return;
+        }
+    }
+}
+
+bool LibraryLock::TryLock(bool shared)
+{
+    if (queued) {
+        return false;
+    }
+    lock_guard<std::mutex> lock(mutex);
+    // no barging in front of the waiters
+    if (!waiters.empty() || !CanGrant(shared)) {
+        return false;
+    }
+    Grant(shared);
+    return true;
+}
+
+void LibraryLock::Unlock(bool shared)
+{
+    lock_guard<std::mutex> lock(mutex);
+    Release(shared);
+    Pump();
+}
+
+// Returns true if the call got the lock, otherwise it's parked,
+// and gets dispatched once it's granted.
+bool LibraryLock::Acquire(AsyncCall* call, bool shared)
+{
+    lock_guard<std::mutex> lock(mutex);
+    if (waiters.empty() && CanGrant(shared)) {
+        Grant(shared);
+        return true;
+    }
+    waiters.push_back(Waiter{ shared, call, nullptr });
+    queued = waiters.size();
+    if (parked++ == 0) {
+        uv_ref((uv_handle_t*)handle);
+    }
+    return false;
+}
+
+// Drops a parked call (on cancellation), returns false if it has been
+// dispatched already.
+bool LibraryLock::Remove(AsyncCall* call)
+{
+    lock_guard<std::mutex> lock(mutex);
+    auto it = find_if(waiters.begin(), waiters.end(), [=](const Waiter& waiter) { return waiter.call == call; });
+    if (it != waiters.end()) {
+        waiters.erase(it);
+        queued = waiters.size();
+    }
+    else {
+        auto git = find(granted.begin(), granted.end(), call);
+        if (git == granted.end()) {
+            return false;
+        }
+        granted.erase(git);
+        Release(call->IsShared());
+    }
+    if (--parked == 0) {
+        uv_unref((uv_handle_t*)handle);
+    }
+    Pump();
+    return true;
+}
+
+// Fails the parked calls, used on the release of the library.
+void LibraryLock::Close(const char* message)
+{
+    for (;;) {
+        AsyncCall* call = nullptr;
+        {
+            lock_guard<std::mutex> lock(mutex);
+            auto it = find_if(waiters.begin(), waiters.end(), [](const Waiter& waiter) { return waiter.call != nullptr; });
+            if (it != waiters.end()) {
+                call = it->call;
+                waiters.erase(it);
+                queued = waiters.size();
+            }
+            else if (!granted.empty()) {
+                call = granted.front();
+                granted.pop_front();
+                Release(call->IsShared());
+            }
+            else {
+                break;
+            }
+            if (--parked == 0) {
+                uv_unref((uv_handle_t*)handle);
+            }
+            Pump();
+        }
+        Nan::HandleScope scope;
+
+        call->Abort(message);
+        delete call;
+    }
+}
+
+void LibraryLock::GetState(unsigned& readers, bool& writer, unsigned& waiting)
+{
+    lock_guard<std::mutex> lock(mutex);
+    readers = this->readers;
+    writer = this->writer;
+    waiting = waiters.size();
+}
+
+void LibraryLock::Ref()
+{
+    refs++;
+}
+
+void LibraryLock::Unref()
+{
+    assert(refs);
+    refs--;
+    DeleteIfUnused();
+}
+
+void LibraryLock::Free()
+{
+    freeing = true;
+    DeleteIfUnused();
+}
+
+void LibraryLock::DeleteIfUnused()
+{
+    if (freeing && !refs) {
+        delete this;
+    }
+}
+
+void LibraryLock::Grant(bool shared)
+{
+    if (shared) {
+        readers++;
+    }
+    else {
+        writer = true;
+    }
+}
+
+void LibraryLock::Release(bool shared)
+{
+    if (shared) {
+        assert(readers);
+        readers--;
+    }
+    else {
+        assert(writer);
+        writer = false;
+    }
+}
+
+// Grants the lock to the waiters at the head of the queue, called with
+// the mutex held.
+void LibraryLock::Pump()
+{
+    bool notify = false;
+    bool send = false;
+    while (!waiters.empty() && CanGrant(waiters.front().shared)) {
+        auto waiter = waiters.front();
+        waiters.pop_front();
+        queued = waiters.size();
+        Grant(waiter.shared);
+        if (waiter.call) {
+            granted.push_back(waiter.call);
+            send = true;
+        }
+        else {
+            *waiter.granted = true;
+        }
+        notify = true;
+    }
+    if (notify) {
+        // the main thread could be waiting in Lock()
+        cond.notify_all();
+    }
+    if (send) {
+        uv_async_send(handle);
+    }
+}
+
+void LibraryLock::DispatchGranted()
+{
+    deque<AsyncCall*> calls;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        calls.swap(granted);
+        parked -= calls.size();
+        if (calls.size() && parked == 0) {
+            uv_unref((uv_handle_t*)handle);
+        }
+    }
+    for (auto call : calls) {
+        call->DispatchLocked();
+    }
+}
+
+void LibraryLock::Granted(uv_async_t* handle)
+{
+    static_cast<LibraryLock*>(handle->data)->DispatchGranted();
+}
+
+namespace {
+NAN_METHOD(newLock)
+{
+    info.GetReturnValue().Set(Wrap<LibraryLock>(new LibraryLock(), [](char* data, void* hint) {
+        reinterpret_cast<LibraryLock*>(data)->Free();
+    }));
+    Nan::AdjustExternalMemory(sizeof(LibraryLock));
+}
+
+NAN_METHOD(closeLock)
+{
+    Unwrap<LibraryLock>(info[0])->Close("Library has been released.");
+}
+
+NAN_METHOD(state)
+{
+    unsigned readers, waiting;
+    bool writer;
+    Unwrap<LibraryLock>(info[0])->GetState(readers, writer, waiting);
+    auto result = Nan::New<Object>();
+    SetValue(result, "readers", Nan::New(readers));
+    SetValue(result, "writer", Nan::New(writer));
+    SetValue(result, "waiting", Nan::New(waiting));
+    info.GetReturnValue().Set(result);
+}
+}
+
+NAN_MODULE_INIT(fastcall::InitLibraryLock)
+{
+    auto _lock = Nan::New<Object>();
+    Nan::Set(target, Nan::New<String>("lock").ToLocalChecked(), _lock);
+    Nan::Set(_lock, Nan::New<String>("newLock").ToLocalChecked(), Nan::New<FunctionTemplate>(newLock)->GetFunction());
+    Nan::Set(_lock, Nan::New<String>("close").ToLocalChecked(), Nan::New<FunctionTemplate>(closeLock)->GetFunction());
+    Nan::Set(_lock, Nan::New<String>("state").ToLocalChecked(), Nan::New<FunctionTemplate>(state)->GetFunction());
+}
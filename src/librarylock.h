@@ -0,0 +1,96 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <nan.h>
+
+namespace fastcall {
+struct AsyncCall;
+
+// Reader/writer lock of a library (or of a lock group of its functions).
+// Waiters are served in FIFO order, so neither the main thread's
+// synchronous calls nor the writers get starved, and consecutive
+// readers at the head of the queue get in together.
+// Asynchronous calls don't block threads while waiting: they get parked in
+// the queue, and the main thread dispatches them once they've been granted
+// the lock, like gates do, the executing thread unlocks it.
+// Lock() spins for a while before blocking (unless there are waiters already),
+// the number of attempts adapts to how often spinning has been successful
+// lately. Uncontended locking and unlocking take the mutex once each.
+// Freed by the garbage collector, but kept alive until the asynchronous
+// calls taking it are done, like gates.
+struct LibraryLock {
+    LibraryLock(const LibraryLock&) = delete;
+    LibraryLock();
+    ~LibraryLock();
+
+    static const unsigned minSpins = 4;
+    static const unsigned maxSpins = 1024;
+
+    // Lock() and the methods of parked calls are used on the main thread only.
+    void Lock(bool shared);
+    bool TryLock(bool shared);
+    void Unlock(bool shared);
+    bool Acquire(AsyncCall* call, bool shared);
+    bool Remove(AsyncCall* call);
+    void Close(const char* message);
+    void GetState(unsigned& readers, bool& writer, unsigned& waiting);
+    // Used by the asynchronous calls taking the lock, on the main thread.
+    void Ref();
+    void Unref();
+    void Free();
+
+private:
+    struct Waiter {
+        bool shared;
+        AsyncCall* call; // or a blocked thread
+        bool* granted;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Waiter> waiters;
+    std::deque<AsyncCall*> granted; // waiting for the main thread
+    unsigned readers = 0;
+    bool writer = false;
+    unsigned parked = 0;
+    std::atomic<unsigned> queued; // the number of waiters, read without the mutex
+    std::atomic<unsigned> spinLimit;
+    uv_async_t* handle;
+    unsigned refs = 0; // used on the main thread only
+    bool freeing = false;
+
+    bool CanGrant(bool shared) const
+    {
+        return !writer && (shared || readers == 0);
+    }
+
+    void Grant(bool shared);
+    void Release(bool shared);
+    void Pump();
+    void DispatchGranted();
+    void DeleteIfUnused();
+
+    static void Granted(uv_async_t* handle);
+};
+
+NAN_MODULE_INIT(InitLibraryLock);
+}
@@ -0,0 +1,534 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "marshal.h"
+#include "deps.h"
+#include "helpers.h"
+#include "getv8value.h"
+#include "int64.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace v8;
+using namespace node;
+using namespace fastcall;
+
+namespace {
+struct Layout;
+
+// Field type codes:
+// c: int8, C: uint8, s: int16, S: uint16, i: int32, I: uint32,
+// l: int64, L: uint64, f: float, d: double, B: bool, p: pointer,
+// t: nested struct (described by layout)
+struct Field {
+    Nan::Global<String> name;
+    string nameStr;
+    char code;
+    size_t offset;
+    size_t count; // 0 for scalars, the length of fixed size arrays otherwise
+    size_t itemSize;
+    unique_ptr<Layout> layout;
+};
+
+struct Layout {
+    size_t size;
+    vector<unique_ptr<Field>> fields;
+};
+
+size_t SizeOf(char code)
+{
+    switch (code) {
+    case 'c':
+    case 'C':
+    case 'B':
+        return 1;
+    case 's':
+    case 'S':
+        return 2;
+    case 'i':
+    case 'I':
+    case 'f':
+        return 4;
+    case 'l':
+    case 'L':
+    case 'd':
+        return 8;
+    case 'p':
+        return sizeof(void*);
+    default:
+        return 0;
+    }
+}
+
+// Struct arrays can be packed, so nothing is assumed about alignment.
+template <typename T>
+inline void Store(char* ptr, T value)
+{
+    memcpy(ptr, &value, sizeof(T));
+}
+
+template <typename T>
+inline T Load(const char* ptr)
+{
+    T value;
+    memcpy(&value, ptr, sizeof(T));
+    return value;
+}
+
+unique_ptr<Layout> ParseLayout(const Local<Object>& desc)
+{
+    Nan::HandleScope scope;
+
+    unique_ptr<Layout> layout(new Layout());
+    layout->size = GetValue(desc, "size")->Uint32Value();
+    auto fields = GetValue<Array>(desc, "fields");
+    for (uint32_t i = 0; i < fields->Length(); i++) {
+        auto fieldDesc = Nan::Get(fields, i).ToLocalChecked().As<Object>();
+        unique_ptr<Field> field(new Field());
+        auto name = GetValue<String>(fieldDesc, "name");
+        field->name.Reset(name);
+        field->nameStr = *Nan::Utf8String(name);
+        Nan::Utf8String code(GetValue(fieldDesc, "code"));
+        field->code = code.length() ? (*code)[0] : '\0';
+        field->offset = GetValue(fieldDesc, "offset")->Uint32Value();
+        field->count = GetValue(fieldDesc, "count")->Uint32Value();
+        if (field->code == 't') {
+            field->layout = ParseLayout(GetValue<Object>(fieldDesc, "layout"));
+            field->itemSize = field->layout->size;
+        }
+        else {
+            field->itemSize = SizeOf(field->code);
+        }
+        if (field->itemSize == 0) {
+            throw logic_error("Field \"" + field->nameStr + "\" has an unknown type.");
+        }
+        if (field->offset + field->itemSize * max(field->count, (size_t)1) > layout->size) {
+            throw logic_error("Field \"" + field->nameStr + "\" is out of the struct's bounds.");
+        }
+        layout->fields.push_back(move(field));
+    }
+    return layout;
+}
+
+void PackStruct(const Layout& layout, char* base, const Local<Object>& obj, const Local<Object>& target);
+
+// Integers are coerced and range checked like by ref's (Buffer's) writers,
+// instead of wrapping around. NaN is written as 0 by those.
+double GetInteger(const Field& field, const Local<Value>& value, double min, double max)
+{
+    double number = value->NumberValue();
+    if (number != number) {
+        return 0;
+    }
+    if (number < min || number > max) {
+        throw range_error("Value of field \"" + field.nameStr + "\" is out of the range of its type.");
+    }
+    return number;
+}
+
+// 64 bit integers are numbers or strings, like by ref's writeInt64().
+void CheckInt64(const Field& field, const Local<Value>& value, double min, double end)
+{
+    if (value->IsString()) {
+        return;
+    }
+    if (!value->IsNumber()) {
+        throw logic_error("Field \"" + field.nameStr + "\" is not a number or a string.");
+    }
+    double number = value->NumberValue();
+    if (!(number >= min && number < end)) {
+        throw range_error("Value of field \"" + field.nameStr + "\" is out of the range of its type.");
+    }
+}
+
+// Like ref._attach(): the pointed object is referenced by the target Buffer,
+// so it's kept alive as long as its address is stored there.
+void Attach(const Local<Object>& target, const Local<Value>& value)
+{
+    Nan::HandleScope scope;
+
+    auto key = Nan::New("_refs").ToLocalChecked();
+    auto refs = Nan::Get(target, key).ToLocalChecked();
+    if (!refs->IsArray()) {
+        refs = Nan::New<Array>();
+        Nan::Set(target, key, refs);
+    }
+    auto arr = refs.As<Array>();
+    Nan::Set(arr, arr->Length(), value);
+}
+
+void PackValue(const Field& field, char* ptr, const Local<Value>& value, const Local<Object>& target)
+{
+    switch (field.code) {
+    case 'c':
+    case 'C':
+        if (value->IsString()) {
+            // the first UTF-16 code unit, like charCodeAt(0) of ref's setters
+            uint16_t unit = 0;
+            value.As<String>()->Write(&unit, 0, 1);
+            Store<uint8_t>(ptr, static_cast<uint8_t>(unit));
+        }
+        else if (field.code == 'c') {
+            Store<int8_t>(ptr, static_cast<int8_t>(GetInteger(field, value, -0x80, 0x7f)));
+        }
+        else {
+            Store<uint8_t>(ptr, static_cast<uint8_t>(GetInteger(field, value, 0, 0xff)));
+        }
+        break;
+    case 'B':
+        if (value->IsNumber()) {
+            Store<uint8_t>(ptr, static_cast<uint8_t>(GetInteger(field, value, 0, 0xff)));
+        }
+        else {
+            Store<uint8_t>(ptr, GetBool(value) ? 1 : 0);
+        }
+        break;
+    case 's':
+        Store<int16_t>(ptr, static_cast<int16_t>(GetInteger(field, value, -0x8000, 0x7fff)));
+        break;
+    case 'S':
+        Store<uint16_t>(ptr, static_cast<uint16_t>(GetInteger(field, value, 0, 0xffff)));
+        break;
+    case 'i':
+        Store<int32_t>(ptr, static_cast<int32_t>(GetInteger(field, value, -2147483648.0, 2147483647.0)));
+        break;
+    case 'I':
+        Store<uint32_t>(ptr, static_cast<uint32_t>(GetInteger(field, value, 0, 4294967295.0)));
+        break;
+    case 'l':
+        CheckInt64(field, value, -9223372036854775808.0, 9223372036854775808.0);
+        Store<int64_t>(ptr, GetInt64(value));
+        break;
+    case 'L':
+        CheckInt64(field, value, 0, 18446744073709551616.0);
+        Store<uint64_t>(ptr, GetUint64(value));
+        break;
+    case 'f':
+        Store<float>(ptr, GetFloat(value));
+        break;
+    case 'd':
+        Store<double>(ptr, GetDouble(value));
+        break;
+    case 'p':
+        Store<void*>(ptr, GetPointer(value));
+        if (!value->IsNull()) {
+            Attach(target, value);
+        }
+        break;
+    }
+}
+
+void PackItem(const Field& field, char* ptr, const Local<Value>& value, const Local<Object>& target)
+{
+    if (field.code != 't') {
+        PackValue(field, ptr, value, target);
+    }
+    else if (Buffer::HasInstance(value)) {
+        memcpy(ptr, Buffer::Data(value), min(Buffer::Length(value), field.itemSize));
+    }
+    else if (value->IsObject()) {
+        PackStruct(*field.layout, ptr, value.As<Object>(), target);
+    }
+    else {
+        throw logic_error("Field \"" + field.nameStr + "\" is not an object.");
+    }
+}
+
+void PackArray(const Field& field, char* ptr, const Local<Value>& value, const Local<Object>& target)
+{
+    size_t byteLength = field.itemSize * field.count;
+    if (Buffer::HasInstance(value)) {
+        memcpy(ptr, Buffer::Data(value), min(Buffer::Length(value), byteLength));
+    }
+    else if (value->IsArrayBufferView()) {
+        Nan::TypedArrayContents<char> contents(value);
+        memcpy(ptr, *contents, min(static_cast<size_t>(contents.length()), byteLength));
+    }
+    else if (value->IsArray()) {
+        auto arr = value.As<Array>();
+        size_t length = min(static_cast<size_t>(arr->Length()), field.count);
+        for (size_t i = 0; i < length; i++) {
+            PackItem(field, ptr + i * field.itemSize, Nan::Get(arr, static_cast<uint32_t>(i)).ToLocalChecked(), target);
+        }
+    }
+    else if (value->IsString() && field.itemSize == 1) {
+        Nan::Utf8String str(value);
+        memcpy(ptr, *str, min(static_cast<size_t>(str.length()), byteLength));
+    }
+    else {
+        throw logic_error("Field \"" + field.nameStr + "\" is not an array.");
+    }
+}
+
+void PackStruct(const Layout& layout, char* base, const Local<Object>& obj, const Local<Object>& target)
+{
+    Nan::HandleScope scope;
+
+    for (auto& field : layout.fields) {
+        auto value = Nan::Get(obj, Nan::New(field->name)).ToLocalChecked();
+        if (value->IsUndefined()) {
+            continue;
+        }
+        char* ptr = base + field->offset;
+        if (field->count) {
+            PackArray(*field, ptr, value, target);
+        }
+        else {
+            PackItem(*field, ptr, value, target);
+        }
+    }
+}
+
+Local<Object> UnpackStruct(const Layout& layout, const char* base);
+
+Local<Value> UnpackValue(char code, const char* ptr)
+{
+    switch (code) {
+    case 'c':
+        return Nan::New<Integer>(Load<int8_t>(ptr));
+    case 'C':
+        return Nan::New<Integer>(Load<uint8_t>(ptr));
+    case 'B':
+        return Nan::New<Boolean>(Load<uint8_t>(ptr) != 0);
+    case 's':
+        return Nan::New<Integer>(Load<int16_t>(ptr));
+    case 'S':
+        return Nan::New<Integer>(Load<uint16_t>(ptr));
+    case 'i':
+        return Nan::New<Integer>(Load<int32_t>(ptr));
+    case 'I':
+        return Nan::New<Integer>(Load<uint32_t>(ptr));
+    case 'l':
+        return MakeInt64(Load<int64_t>(ptr));
+    case 'L':
+        return MakeUint64(Load<uint64_t>(ptr));
+    case 'f':
+        return Nan::New<Number>(Load<float>(ptr));
+    case 'd':
+        return Nan::New<Number>(Load<double>(ptr));
+    case 'p':
+        return WrapPointer(Load<char*>(ptr));
+    default:
+        return Nan::Undefined();
+    }
+}
+
+Local<Value> UnpackItem(const Field& field, const char* ptr)
+{
+    if (field.code == 't') {
+        return UnpackStruct(*field.layout, ptr);
+    }
+    return UnpackValue(field.code, ptr);
+}
+
+Local<Object> UnpackStruct(const Layout& layout, const char* base)
+{
+    Nan::EscapableHandleScope scope;
+
+    auto obj = Nan::New<Object>();
+    for (auto& field : layout.fields) {
+        const char* ptr = base + field->offset;
+        Local<Value> value;
+        if (field->count) {
+            auto arr = Nan::New<Array>(static_cast<int>(field->count));
+            for (size_t i = 0; i < field->count; i++) {
+                Nan::Set(arr, static_cast<uint32_t>(i), UnpackItem(*field, ptr + i * field->itemSize));
+            }
+            value = arr;
+        }
+        else {
+            value = UnpackItem(*field, ptr);
+        }
+        Nan::Set(obj, Nan::New(field->name), value);
+    }
+    return scope.Escape(obj);
+}
+
+void GetBytes(const Local<Value>& value, char*& data, size_t& length)
+{
+    if (Buffer::HasInstance(value)) {
+        data = Buffer::Data(value);
+        length = Buffer::Length(value);
+    }
+    else if (value->IsArrayBufferView()) {
+        Nan::TypedArrayContents<char> contents(value);
+        data = *contents;
+        length = contents.length();
+    }
+    else {
+        throw logic_error("Argument is not a Buffer or a TypedArray.");
+    }
+}
+
+// Copies count items of itemSize bytes between a strided region
+// (a column of a struct array) and a contiguous one.
+void StridedCopy(const Nan::FunctionCallbackInfo<Value>& info, bool gather)
+{
+    char* strided;
+    size_t stridedLength;
+    GetBytes(info[0], strided, stridedLength);
+    size_t stridedOffset = info[1]->Uint32Value();
+    size_t stride = info[2]->Uint32Value();
+    size_t itemSize = info[3]->Uint32Value();
+    size_t count = info[4]->Uint32Value();
+    char* packed;
+    size_t packedLength;
+    GetBytes(info[5], packed, packedLength);
+    size_t packedOffset = info[6]->Uint32Value();
+    if (count == 0) {
+        return;
+    }
+    if (stride < itemSize || stridedOffset + (count - 1) * stride + itemSize > stridedLength) {
+        throw logic_error("Column is out of the struct array's bounds.");
+    }
+    if (packedOffset + count * itemSize > packedLength) {
+        throw logic_error("Target is too small.");
+    }
+
+    strided += stridedOffset;
+    packed += packedOffset;
+    for (size_t i = 0; i < count; i++, strided += stride, packed += itemSize) {
+        if (gather) {
+            memcpy(packed, strided, itemSize);
+        }
+        else {
+            memcpy(strided, packed, itemSize);
+        }
+    }
+}
+
+NAN_METHOD(newLayout)
+{
+    try {
+        if (!info[0]->IsObject()) {
+            throw logic_error("Argument is not a layout descriptor.");
+        }
+        auto layout = ParseLayout(info[0].As<Object>());
+        info.GetReturnValue().Set(Wrap<Layout>(layout.release()));
+    }
+    catch (exception& ex) {
+        Nan::ThrowTypeError(ex.what());
+    }
+}
+
+// pack(layout, array, start, count, buffer, byteOffset)
+NAN_METHOD(pack)
+{
+    try {
+        auto layout = Unwrap<Layout>(info[0]);
+        if (!info[1]->IsArray()) {
+            throw logic_error("Argument is not an array.");
+        }
+        auto arr = info[1].As<Array>();
+        size_t start = info[2]->Uint32Value();
+        size_t count = info[3]->Uint32Value();
+        if (start + count > arr->Length()) {
+            throw logic_error("Range is out of the array's bounds.");
+        }
+        if (!Buffer::HasInstance(info[4])) {
+            throw logic_error("Argument is not a Buffer.");
+        }
+        char* data = Buffer::Data(info[4]);
+        size_t byteOffset = info[5]->Uint32Value();
+        if (byteOffset + count * layout->size > Buffer::Length(info[4])) {
+            throw logic_error("Buffer is too small.");
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            Nan::HandleScope scope;
+
+            auto item = Nan::Get(arr, static_cast<uint32_t>(start + i)).ToLocalChecked();
+            if (!item->IsObject()) {
+                throw logic_error("Item " + to_string(start + i) + " is not an object.");
+            }
+            PackStruct(*layout, data + byteOffset + i * layout->size, item.As<Object>(), info[4].As<Object>());
+        }
+    }
+    catch (range_error& ex) {
+        Nan::ThrowRangeError(ex.what());
+    }
+    catch (exception& ex) {
+        Nan::ThrowTypeError(ex.what());
+    }
+}
+
+// unpack(layout, buffer, byteOffset, count)
+NAN_METHOD(unpack)
+{
+    try {
+        auto layout = Unwrap<Layout>(info[0]);
+        if (!Buffer::HasInstance(info[1])) {
+            throw logic_error("Argument is not a Buffer.");
+        }
+        const char* data = Buffer::Data(info[1]);
+        size_t byteOffset = info[2]->Uint32Value();
+        size_t count = info[3]->Uint32Value();
+        if (byteOffset + count * layout->size > Buffer::Length(info[1])) {
+            throw logic_error("Buffer is too small.");
+        }
+
+        auto result = Nan::New<Array>(static_cast<int>(count));
+        for (size_t i = 0; i < count; i++) {
+            Nan::HandleScope scope;
+
+            Nan::Set(result, static_cast<uint32_t>(i), UnpackStruct(*layout, data + byteOffset + i * layout->size));
+        }
+        info.GetReturnValue().Set(result);
+    }
+    catch (exception& ex) {
+        Nan::ThrowTypeError(ex.what());
+    }
+}
+
+// gather(buffer, byteOffset, stride, itemSize, count, target, targetOffset)
+NAN_METHOD(gather)
+{
+    try {
+        StridedCopy(info, true);
+    }
+    catch (exception& ex) {
+        Nan::ThrowTypeError(ex.what());
+    }
+}
+
+// scatter(buffer, byteOffset, stride, itemSize, count, source, sourceOffset)
+NAN_METHOD(scatter)
+{
+    try {
+        StridedCopy(info, false);
+    }
+    catch (exception& ex) {
+        Nan::ThrowTypeError(ex.what());
+    }
+}
+}
+
+NAN_MODULE_INIT(fastcall::InitMarshal)
+{
+    auto marshal = Nan::New<Object>();
+    Nan::Set(target, Nan::New<String>("marshal").ToLocalChecked(), marshal);
+    Nan::Set(marshal, Nan::New<String>("newLayout").ToLocalChecked(), Nan::New<FunctionTemplate>(newLayout)->GetFunction());
+    Nan::Set(marshal, Nan::New<String>("pack").ToLocalChecked(), Nan::New<FunctionTemplate>(pack)->GetFunction());
+    Nan::Set(marshal, Nan::New<String>("unpack").ToLocalChecked(), Nan::New<FunctionTemplate>(unpack)->GetFunction());
+    Nan::Set(marshal, Nan::New<String>("gather").ToLocalChecked(), Nan::New<FunctionTemplate>(gather)->GetFunction());
+    Nan::Set(marshal, Nan::New<String>("scatter").ToLocalChecked(), Nan::New<FunctionTemplate>(scatter)->GetFunction());
+}
@@ -14,31 +14,9 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
-'use strict';
-const _ = require('lodash');
-const assert = require('assert');
-const verify = require('./verify');
-const a = verify.a;
-const ert = verify.ert;
-const Promise = require('bluebird');
+#pragma once
+#include <nan.h>
 
-let top = Promise.resolve();
-let length = 0;
-
-Object.defineProperty(exports, 'length', { get: () => length });
-
-exports.next = function (f) {
-    a&&ert(_.isFunction(f));
-
-    length++;        
-    top = top
-    .catch(_.noop)
-    .then(() => {
-        return Promise.try(f);
-    })
-    .finally(() => {
-        length--;
-    });
-
-    return top;
-}
\ No newline at end of file
+namespace fastcall {
+NAN_MODULE_INIT(InitMarshal);
+}
@@ -0,0 +1,154 @@
+/*
+Copyright 2016 Gábor Mező (gabor.mezo@outlook.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <dyncall.h>
+#include <string>
+
+namespace fastcall {
+// Calls packed into memory shared with JS, used by call rings and batches.
+// A packed call takes 64 bytes: uint32 function index, uint32 (unused),
+// double args[7]. Arguments and results are passed as doubles typed by
+// the dyncall type codes of the function, so 64 bit integers are exact
+// up to 2^53 (that covers pointers too).
+struct PackedFunction {
+    static const unsigned maxArgs = 7;
+    static const unsigned callSize = 64;
+
+    DCpointer ptr = nullptr;
+    char args[maxArgs];
+    unsigned argCount = 0;
+    char result = 'v';
+
+    // Returns false if the function has unsupported argument or result types.
+    bool Init(DCpointer funcPtr, const std::string& argCodes, char resultCode)
+    {
+        if (argCodes.length() > maxArgs || (resultCode != 'v' && !IsValidCode(resultCode))) {
+            return false;
+        }
+        for (unsigned i = 0; i < argCodes.length(); i++) {
+            if (!IsValidCode(argCodes[i])) {
+                return false;
+            }
+            args[i] = argCodes[i];
+        }
+        ptr = funcPtr;
+        argCount = argCodes.length();
+        result = resultCode;
+        return true;
+    }
+
+    double Call(DCCallVM* vm, const char* packedArgs) const
+    {
+        dcReset(vm);
+        for (unsigned i = 0; i < argCount; i++) {
+            double value;
+            memcpy(&value, packedArgs + i * 8, sizeof(double));
+            PushArg(vm, args[i], value);
+        }
+        return CallFunc(vm);
+    }
+
+    static bool IsValidCode(char code)
+    {
+        return code && strchr("BcCsSiIjJlLfdp", code) != nullptr;
+    }
+
+private:
+    static void PushArg(DCCallVM* vm, char code, double value)
+    {
+        switch (code) {
+        case 'B':
+            dcArgBool(vm, value != 0);
+            break;
+        case 'c':
+        case 'C':
+            dcArgChar(vm, static_cast<DCchar>(static_cast<int>(value)));
+            break;
+        case 's':
+        case 'S':
+            dcArgShort(vm, static_cast<DCshort>(static_cast<int>(value)));
+            break;
+        case 'i':
+            dcArgInt(vm, static_cast<DCint>(value));
+            break;
+        case 'I':
+            dcArgInt(vm, static_cast<DCint>(static_cast<uint32_t>(value)));
+            break;
+        case 'j':
+        case 'J':
+            dcArgLong(vm, static_cast<DClong>(value));
+            break;
+        case 'l':
+        case 'L':
+            dcArgLongLong(vm, static_cast<DClonglong>(value));
+            break;
+        case 'f':
+            dcArgFloat(vm, static_cast<DCfloat>(value));
+            break;
+        case 'd':
+            dcArgDouble(vm, value);
+            break;
+        case 'p':
+            dcArgPointer(vm, reinterpret_cast<DCpointer>(static_cast<uintptr_t>(value)));
+            break;
+        }
+    }
+
+    double CallFunc(DCCallVM* vm) const
+    {
+        switch (result) {
+        case 'B':
+            return dcCallBool(vm, ptr) ? 1 : 0;
+        case 'c':
+            return static_cast<int8_t>(dcCallChar(vm, ptr));
+        case 'C':
+            return static_cast<uint8_t>(dcCallChar(vm, ptr));
+        case 's':
+            return dcCallShort(vm, ptr);
+        case 'S':
+            return static_cast<uint16_t>(dcCallShort(vm, ptr));
+        case 'i':
+            return dcCallInt(vm, ptr);
+        case 'I':
+            return static_cast<uint32_t>(dcCallInt(vm, ptr));
+        case 'j':
+            return static_cast<double>(dcCallLong(vm, ptr));
+        case 'J':
+            return static_cast<double>(static_cast<unsigned long>(dcCallLong(vm, ptr)));
+        case 'l':
+            return static_cast<double>(dcCallLongLong(vm, ptr));
+        case 'L':
+            return static_cast<double>(static_cast<unsigned long long>(dcCallLongLong(vm, ptr)));
+        case 'f':
+            return dcCallFloat(vm, ptr);
+        case 'd':
+            return dcCallDouble(vm, ptr);
+        case 'p':
+            return static_cast<double>(reinterpret_cast<uintptr_t>(dcCallPointer(vm, ptr)));
+        default:
+            dcCallVoid(vm, ptr);
+            return 0;
+        }
+    }
+};
+
+// Size of call VMs making packed calls.
+const size_t packedCallVMSize = 16 + PackedFunction::maxArgs * 16;
+}
@@ -1,5 +1,11 @@
 #include "weak.h"
 #include "deps.h"
+#include "getv8value.h"
+#include "helpers.h"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
 
 using namespace std;
 using namespace v8;
@@ -47,6 +53,216 @@ NAN_METHOD(watch)
     new WatchStuff(info[0].As<Object>(), info[1].As<Function>());
 }
 
+// Finalization registry: one weak handle and one table entry per registered
+// object, without JS callbacks. Collected entries are queued, and processed
+// in batches on the next loop iteration (or by flush()): native dispose
+// functions get called right here, and the ids of the entries having JS side
+// dispose functions get passed to the registered callback in one array.
+// External memory is accounted in aggregate, V8 gets notified only when the
+// unreported amount exceeds ReportThreshold.
+typedef void (*DisposeFunction)(void*);
+
+struct Entry {
+    Nan::Persistent<Object> handle;
+    DisposeFunction func = nullptr;
+    void* data = nullptr;
+    int64_t externalMemory = 0;
+    bool js = false;
+    uint32_t id = 0;
+};
+
+const int64_t ReportThreshold = 1024 * 1024;
+
+vector<unique_ptr<Entry>> entries;
+vector<uint32_t> freeIds;
+vector<Entry*> pending;
+size_t liveCount = 0;
+int64_t externalMemory = 0;
+int64_t unreportedMemory = 0;
+uv_async_t* flushHandle = nullptr;
+Nan::Persistent<Function> finalizerCallback;
+
+void AccountMemory(int64_t delta)
+{
+    externalMemory += delta;
+    unreportedMemory += delta;
+    if (unreportedMemory >= ReportThreshold || unreportedMemory <= -ReportThreshold) {
+        Nan::AdjustExternalMemory(static_cast<int>(unreportedMemory));
+        unreportedMemory = 0;
+    }
+}
+
+void ReleaseEntry(Entry* entry)
+{
+    auto id = entry->id;
+    entries[id].reset();
+    freeIds.push_back(id);
+    liveCount--;
+}
+
+void EntryCollected(const Nan::WeakCallbackInfo<Entry>& data)
+{
+    auto entry = data.GetParameter();
+    entry->handle.Reset();
+    if (pending.empty()) {
+        uv_async_send(flushHandle);
+    }
+    pending.push_back(entry);
+}
+
+void Flush()
+{
+    if (pending.empty()) {
+        return;
+    }
+
+    Nan::HandleScope scope;
+
+    vector<Entry*> batch;
+    batch.swap(pending);
+    int64_t freedMemory = 0;
+    size_t jsCount = 0;
+    for (auto entry : batch) {
+        if (entry->func) {
+            entry->func(entry->data);
+        }
+        if (entry->js) {
+            jsCount++;
+        }
+        freedMemory += entry->externalMemory;
+    }
+    AccountMemory(-freedMemory);
+
+    // Ids are released after the callback has returned,
+    // so the ones registered by JS dispose functions won't collide.
+    if (jsCount && !finalizerCallback.IsEmpty()) {
+        auto ids = Nan::New<Array>(static_cast<int>(jsCount));
+        uint32_t i = 0;
+        for (auto entry : batch) {
+            if (entry->js) {
+                Nan::Set(ids, i++, Nan::New(entry->id));
+            }
+        }
+        Local<Value> args[] = { ids };
+        Nan::New(finalizerCallback)->Call(Nan::Undefined(), 1, args);
+    }
+
+    for (auto entry : batch) {
+        ReleaseEntry(entry);
+    }
+}
+
+// Errors of JS dispose functions cannot propagate out of a libuv callback,
+// so those are reported as process warnings.
+void EmitWarning(const Local<Value>& error)
+{
+    Nan::HandleScope scope;
+    Nan::TryCatch tryCatch;
+
+    auto process = GetValue<Object>(GetGlobal(), "process");
+    auto emitWarning = GetValue(process, "emitWarning");
+    if (emitWarning->IsFunction()) {
+        Local<Value> args[] = { error };
+        emitWarning.As<Function>()->Call(process, 1, args);
+    }
+    if (!emitWarning->IsFunction() || tryCatch.HasCaught()) {
+        fprintf(stderr, "fastcall: dispose function failed: %s\n", *Nan::Utf8String(error));
+    }
+}
+
+void FlushAsync(uv_async_t* handle)
+{
+    Nan::HandleScope scope;
+    Nan::TryCatch tryCatch;
+
+    Flush();
+    if (tryCatch.HasCaught()) {
+        EmitWarning(tryCatch.Exception());
+    }
+}
+
+// register(obj, disposeFunctionPtr, dataPtr, externalMemory, hasJSDispose) -> id
+NAN_METHOD(_register)
+{
+    try {
+        if (!info[0]->IsObject()) {
+            throw logic_error("1st argument is not an object.");
+        }
+        auto func = reinterpret_cast<DisposeFunction>(GetPointer(info[1]));
+        auto data = GetPointer(info[2]);
+        int64_t memory = info[3]->IsNumber() ? static_cast<int64_t>(info[3]->NumberValue()) : 0;
+
+        uint32_t id;
+        if (freeIds.empty()) {
+            id = static_cast<uint32_t>(entries.size());
+            entries.emplace_back();
+        }
+        else {
+            id = freeIds.back();
+            freeIds.pop_back();
+        }
+        auto entry = new Entry();
+        entries[id].reset(entry);
+        entry->id = id;
+        entry->func = func;
+        entry->data = data;
+        entry->externalMemory = memory;
+        entry->js = GetBool(info[4]);
+        entry->handle.Reset(info[0].As<Object>());
+        entry->handle.SetWeak(entry, EntryCollected, Nan::WeakCallbackType::kParameter);
+        liveCount++;
+        AccountMemory(memory);
+
+        info.GetReturnValue().Set(Nan::New(id));
+    }
+    catch (exception& ex) {
+        Nan::ThrowTypeError(ex.what());
+    }
+}
+
+// unregister(id, callNativeDispose) -> whether the entry was alive
+NAN_METHOD(unregister)
+{
+    auto id = info[0]->Uint32Value();
+    if (id >= entries.size() || !entries[id] || entries[id]->handle.IsEmpty()) {
+        return info.GetReturnValue().Set(false);
+    }
+
+    auto entry = entries[id].get();
+    entry->handle.ClearWeak();
+    entry->handle.Reset();
+    if (entry->func && GetBool(info[1])) {
+        entry->func(entry->data);
+    }
+    AccountMemory(-entry->externalMemory);
+    ReleaseEntry(entry);
+    info.GetReturnValue().Set(true);
+}
+
+NAN_METHOD(setFinalizerCallback)
+{
+    if (info[0]->IsFunction()) {
+        finalizerCallback.Reset(info[0].As<Function>());
+    }
+    else {
+        finalizerCallback.Reset();
+    }
+}
+
+NAN_METHOD(flush)
+{
+    Flush();
+}
+
+NAN_METHOD(stats)
+{
+    auto result = Nan::New<Object>();
+    SetValue(result, "count", Nan::New<Number>(static_cast<double>(liveCount - pending.size())));
+    SetValue(result, "pending", Nan::New<Number>(static_cast<double>(pending.size())));
+    SetValue(result, "externalMemory", Nan::New<Number>(static_cast<double>(externalMemory)));
+    info.GetReturnValue().Set(result);
+}
+
 NAN_METHOD(adjustExternalMemory)
 {
     if (!info[0]->IsNumber()) {
@@ -64,4 +280,15 @@ NAN_MODULE_INIT(fastcall::InitWeak)
     Nan::Set(target, Nan::New<String>("weak").ToLocalChecked(), weak);
     Nan::Set(weak, Nan::New<String>("watch").ToLocalChecked(), Nan::New<FunctionTemplate>(watch)->GetFunction());
     Nan::Set(weak, Nan::New<String>("adjustExternalMemory").ToLocalChecked(), Nan::New<FunctionTemplate>(adjustExternalMemory)->GetFunction());
+    Nan::Set(weak, Nan::New<String>("register").ToLocalChecked(), Nan::New<FunctionTemplate>(_register)->GetFunction());
+    Nan::Set(weak, Nan::New<String>("unregister").ToLocalChecked(), Nan::New<FunctionTemplate>(unregister)->GetFunction());
+    Nan::Set(weak, Nan::New<String>("setFinalizerCallback").ToLocalChecked(), Nan::New<FunctionTemplate>(setFinalizerCallback)->GetFunction());
+    Nan::Set(weak, Nan::New<String>("flush").ToLocalChecked(), Nan::New<FunctionTemplate>(flush)->GetFunction());
+    Nan::Set(weak, Nan::New<String>("stats").ToLocalChecked(), Nan::New<FunctionTemplate>(stats)->GetFunction());
+
+    if (!flushHandle) {
+        flushHandle = new uv_async_t;
+        uv_async_init(uv_default_loop(), flushHandle, FlushAsync);
+        uv_unref((uv_handle_t*)flushHandle);
+    }
 }
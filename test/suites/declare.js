@@ -23,6 +23,10 @@ const _ = require('lodash');
 const ref = fastcall.ref;
 const Promise = require('bluebird');
 const async = Promise.coroutine;
+const os = require('os');
+const path = require('path');
+const fs = require('fs');
+const rex = require('../../lib/rex');
 
 describe(`Library.declare()`, function () {
     let libPath = null;
@@ -75,6 +79,80 @@ describe(`Library.declare()`, function () {
         }));
     });
 
+    describe('cache', function () {
+        let cacheDir = null;
+
+        beforeEach(function () {
+            cacheDir = path.join(os.tmpdir(), `fastcall-test-cache-${ process.pid }-${ Date.now() }`);
+        });
+
+        afterEach(function () {
+            if (!fs.existsSync(cacheDir)) {
+                return;
+            }
+            for (const file of fs.readdirSync(cacheDir)) {
+                fs.unlinkSync(path.join(cacheDir, file));
+            }
+            fs.rmdirSync(cacheDir);
+        });
+
+        it('should reuse parsed declarations from options.cacheDir', function () {
+            lib = new Library(libPath, { cacheDir });
+            lib.declare(declaration);
+            lib.release();
+            assert.equal(fs.readdirSync(cacheDir).length, 1);
+
+            const matchFunction = rex.matchFunction;
+            const matchFields = rex.matchFields;
+            let matchCount = 0;
+            rex.matchFunction = function () {
+                matchCount++;
+                return matchFunction.apply(this, arguments);
+            };
+            rex.matchFields = function () {
+                matchCount++;
+                return matchFields.apply(this, arguments);
+            };
+            try {
+                lib = new Library(libPath, { cacheDir });
+                lib.declare(declaration);
+            }
+            finally {
+                rex.matchFunction = matchFunction;
+                rex.matchFields = matchFields;
+            }
+            assert.equal(matchCount, 0);
+            assert(lib.structs.TStuff.type.layoutApplied);
+            assert(lib.unions.T42.type.layoutApplied);
+            testSyncInterface();
+            testRefInterface();
+        });
+
+        it('should not take cached layouts of different field types', function () {
+            lib = new Library(libPath, { cacheDir });
+            lib.declare('struct TPair { int a; int b; };');
+            lib.release();
+
+            lib = new Library(libPath, { cacheDir });
+            lib.declare('struct TPair { int a; int b; };');
+            const pair = lib.structs.TPair.type;
+            assert(pair.layoutApplied);
+            assert.equal(pair.size, 8);
+
+            const Other = new fastcall.StructType({ a: 'double', b: 'int' }, { layout: pair.getLayout() });
+            assert(!Other.layoutApplied);
+            assert.equal(Other.fields.b.offset, 8);
+            assert.equal(Other.size, 16);
+        });
+
+        it('should work without a writable cache directory', function () {
+            lib = new Library(libPath, { cacheDir: path.join(cacheDir, 'not', 'there') });
+            lib.declare(declaration);
+            testSyncInterface();
+            assert(!fs.existsSync(cacheDir));
+        });
+    });
+
     function testSyncInterface() {
         assert(_.isFunction(lib.interface.mul));
         assert(_.isObject(lib.interface.mul.function));
@@ -16,6 +16,7 @@ limitations under the License.
 
 'use strict';
 const native = require('../../lib/native');
+const ref = require('../../lib/ref-libs/ref');
 const helpers = require('./helpers');
 const assert = require('assert');
 const _ = require('lodash');
@@ -64,4 +65,31 @@ describe('native dynload interface', function () {
         assert(dynload.findSymbol(pLib, '42') === null);
         dynload.freeLibrary(pLib);
     });
+
+    it('should resolve many symbols at once', function () {
+        const pLib = dynload.loadLibrary(libPath);
+        const ptrs = dynload.resolveAll(pLib, ['mul', '42', 'makeInt']);
+        assert.equal(ptrs.length, 3);
+        assert(_.isBuffer(ptrs[0]));
+        assert(ptrs[1] === null);
+        assert(_.isBuffer(ptrs[2]));
+        assert.equal(ref.address(ptrs[0]), ref.address(dynload.findSymbol(pLib, 'mul')));
+        dynload.freeLibrary(pLib);
+    });
+
+    it('should resolve many symbols at once in the background', function (done) {
+        const pLib = dynload.loadLibrary(libPath);
+        dynload.resolveAllAsync(pLib, ['mul', '42'], (err, ptrs) => {
+            dynload.freeLibrary(pLib);
+            try {
+                assert(!err);
+                assert(_.isBuffer(ptrs[0]));
+                assert(ptrs[1] === null);
+                done();
+            }
+            catch (err) {
+                done(err);
+            }
+        });
+    });
 });
\ No newline at end of file
@@ -22,6 +22,7 @@ const async = Promise.coroutine;
 const fastcall = require('../../lib');
 const scope = fastcall.scope;
 const Disposable = fastcall.Disposable;
+const helpers = require('./helpers');
 
 class Tester extends Disposable {
 }
@@ -151,6 +152,28 @@ describe('RAII scope', function () {
                 });
             });
         });
+
+        it('should free the arena at the end', function () {
+            let arena = null;
+            scope(() => {
+                arena = scope.arena;
+                assert.strictEqual(scope.arena, arena);
+                const intPtr = arena.alloc('int', 42);
+                assert.equal(intPtr.deref(), 42);
+                const zeros = arena.allocBytes(100);
+                assert(_.every(zeros, b => b === 0));
+                const str = arena.allocCString('hello');
+                assert.equal(fastcall.ref.readCString(str, 0), 'hello');
+                const big = arena.allocBytes(arena.blockSize * 2);
+                assert.equal(big.length, arena.blockSize * 2);
+                scope(() => {
+                    assert.notStrictEqual(scope.arena, arena);
+                });
+                assert(!arena.freed);
+            });
+            assert(arena.freed);
+            assert.throws(() => arena.allocBytes(1));
+        });
     });
 
     describe('async', function () {
@@ -186,36 +209,54 @@ describe('RAII scope', function () {
             });
             assert.equal(counter, 2);
         }));
+
+        it('should free the arena after the body has finished', async(function* () {
+            let arena = null;
+            yield scope.async(function* () {
+                arena = scope.arena;
+                const ptr = arena.alloc('double', 1.5);
+                yield Promise.delay(1);
+                assert(!arena.freed);
+                assert.equal(ptr.deref(), 1.5);
+            });
+            assert(arena.freed);
+        }));
     });
 
     describe('dispose', function () {
         describe('GC', function () {
+            // dispose functions of the collected objects get called in batches
+            function collect() {
+                gc();
+                Disposable.flush();
+            }
+
             it('should call dispose function', function () {
                 let counter = 0;
                 const dispose = () => counter++;
                 let value2;
                 const f = () => {
                     const value = new Tester(dispose);
-                    gc();
+                    collect();
                     assert(!counter);
                     value2 = value;
                     value2 = new Tester(dispose, 42);
                     assert(!counter);
-                    gc();
+                    collect();
                 };
                 let value3 = new Tester(dispose);
 
                 f();
                 assert(!counter);
-                gc();
+                collect();
                 assert.equal(counter, 1);
                 value2 = null;
-                gc();
+                collect();
                 assert.equal(counter, 2);
                 value3.dispose();
                 assert.equal(counter, 3);
                 value3 = null;
-                gc();
+                collect();
                 assert.equal(counter, 3);
             });
 
@@ -224,22 +265,84 @@ describe('RAII scope', function () {
                 const dispose1 = () => counter++;
                 const dispose2 = () => counter += 100;
                 let test = new Tester(dispose1, 10);
-                gc();
+                collect();
                 assert(!counter);
                 test.resetDisposable(dispose2);
                 assert(!counter);
-                gc();
+                collect();
                 assert.equal(counter, 1);
                 test.resetDisposable(dispose1);
                 assert.equal(counter, 1);
                 test.dispose();
                 assert.equal(counter, 2);
-                gc();
+                collect();
                 assert.equal(counter, 102);
                 test = null;
-                gc();
+                collect();
                 assert.equal(counter, 102);
             });
+
+            it('should report errors of dispose functions as warnings', async(function* () {
+                const warnings = [];
+                const onWarning = warning => warnings.push(warning);
+                process.on('warning', onWarning);
+                try {
+                    let value = new Tester(() => {
+                        throw new Error('dispose failed');
+                    });
+                    value = null;
+                    gc();
+                    // processed by the loop, instead of flush()
+                    for (let i = 0; i < 10 && !warnings.length; i++) {
+                        yield Promise.delay(10);
+                    }
+                    assert.equal(warnings.length, 1);
+                    assert.equal(warnings[0].message, 'dispose failed');
+                }
+                finally {
+                    process.removeListener('warning', onWarning);
+                }
+            }));
+
+            it('should throw errors of dispose functions by flush()', function () {
+                let value = new Tester(() => {
+                    throw new Error('dispose failed');
+                });
+                value = null;
+                gc();
+                assert.throws(() => Disposable.flush(), /dispose failed/);
+            });
+
+            it('should call native dispose functions without JS callbacks', async(function* () {
+                const lib = new fastcall.Library(yield helpers.findTestlib());
+                try {
+                    lib.function('void makeRecWithArrays(void** records, long* size)');
+                    const freeRecWithArrays = lib.getSymbol('freeRecWithArrays');
+                    const makeRecords = () => {
+                        const recordsRef = fastcall.ref.alloc('pointer');
+                        lib.interface.makeRecWithArrays(recordsRef, fastcall.ref.alloc('long'));
+                        return recordsRef.deref();
+                    };
+                    const initial = Disposable.stats();
+
+                    let value1 = new Tester(Disposable.native(freeRecWithArrays, makeRecords()), 1000);
+                    const value2 = new Tester(Disposable.native(freeRecWithArrays, makeRecords()), 500);
+                    assert.equal(Disposable.stats().count, initial.count + 2);
+                    assert.equal(Disposable.stats().externalMemory, initial.externalMemory + 1500);
+
+                    value1 = null;
+                    collect();
+                    assert.equal(Disposable.stats().count, initial.count + 1);
+                    assert.equal(Disposable.stats().externalMemory, initial.externalMemory + 500);
+
+                    value2.dispose();
+                    assert.equal(Disposable.stats().count, initial.count);
+                    assert.equal(Disposable.stats().externalMemory, initial.externalMemory);
+                }
+                finally {
+                    lib.release();
+                }
+            }));
         });
     });
 });
\ No newline at end of file
@@ -75,6 +75,40 @@ describe(`ref types`, function () {
             testStructInterface();
         });
 
+        it('should convert from and to plain objects', function () {
+            const TMixed = new StructType({
+                a: 'char',
+                b: 'double',
+                c: 'int',
+                d: 'bool',
+                e: 'int64',
+                f: 'pointer'
+            });
+            const mixed = TMixed.fromObject({ a: 'x', b: 1.5, c: -7, d: true, e: 42, f: ref.NULL });
+            assert.equal(mixed.a, 120);
+            assert.equal(mixed.b, 1.5);
+            assert.equal(mixed.c, -7);
+            assert.strictEqual(mixed.d, true);
+            assert.equal(mixed.e, 42);
+            assert.equal(mixed.ref()['readDouble' + ref.endianness](8), 1.5);
+            mixed.c = 8;
+            mixed.d = 0;
+
+            const obj = mixed.toObject();
+            assert.deepEqual(_.omit(obj, 'f'), { a: 120, b: 1.5, c: 8, d: false, e: 42 });
+            assert(ref.isNull(obj.f));
+        });
+
+        it('should compile the accessors again when fields get added', function () {
+            const TGrowing = new StructType({ a: 'int' });
+            // compiles the accessors, but fails before creating the instance
+            assert.throws(() => new TGrowing(new Buffer(0)));
+            TGrowing.defineProperty('b', 'double');
+            const growing = TGrowing.fromObject({ a: 1, b: 2.5 });
+            assert.equal(growing.ref()['readDouble' + ref.endianness](8), 2.5);
+            assert.deepEqual(growing.toObject(), { a: 1, b: 2.5 });
+        });
+
         describe('sync', function () {
             it('should get referenced by string syntax', function () {
                 lib.struct({
@@ -385,6 +419,47 @@ describe(`ref types`, function () {
             assert.throws(() => arr[4] = 0);
         });
 
+        it('should access number arrays through a TypedArray', function () {
+            const DoubleArray = new ArrayType('double');
+            const arr = new DoubleArray([1.5, 2.5, 3.5]);
+            assert(arr.typedArray instanceof Float64Array);
+            assert.equal(arr.typedArray.buffer, arr.buffer.buffer);
+            assert.equal(arr.get(1), 2.5);
+            arr.set(2, 9);
+            assert.equal(arr.buffer['readDouble' + ref.endianness](16), 9);
+            arr.set([7, 8], 1);
+            assert.deepEqual(arr.toArray(), [1.5, 7, 8]);
+
+            const copy = new DoubleArray(3);
+            copy.set(arr);
+            assert.deepEqual(copy.toArray(), [1.5, 7, 8]);
+
+            const CharArray = new ArrayType('char');
+            const chars = new CharArray(['a', 'b']);
+            assert.deepEqual(chars.toArray(), [97, 98]);
+
+            const Int64Array = new ArrayType('int64');
+            assert.strictEqual(new Int64Array([1]).typedArray, null);
+        });
+
+        it('should range check values like the Buffer writers', function () {
+            const UInt8Array = new ArrayType('uint8');
+            assert.throws(() => new UInt8Array([1, 300]));
+            const arr = new UInt8Array([1, 2, 3]);
+            assert(arr.typedArray);
+            assert.throws(() => arr.set(0, -1));
+            assert.throws(() => arr.set([256, 4], 1));
+            assert.throws(() => arr.set(new Float64Array([1e10])));
+            assert.deepEqual(arr.toArray(), [1, 2, 3]);
+            arr.set(new Uint8Array([7, 8]), 1);
+            assert.deepEqual(arr.toArray(), [1, 7, 8]);
+
+            const copy = new UInt8Array([1, 7, 8]);
+            assert.deepEqual(Object.keys(arr), Object.keys(copy));
+            assert(!_.includes(Object.keys(arr), '_view'));
+            assert(!_.includes(Object.keys(arr), '_viewBuffer'));
+        });
+
         describe('fixed length', function () {
             it('could be created by plain object definition', function () {
                 const result = lib
@@ -412,6 +487,101 @@ describe(`ref types`, function () {
                 testArrayInterface(true);
             });
 
+            it('should pack and unpack arrays of records', function () {
+                const TRecWithArray = new StructType({
+                    values: new ArrayType(ref.types.long, 5),
+                    index: 'uint'
+                });
+                lib.struct({ TRecWithArray });
+                lib.function('void incRecWithArrays(TRecWithArray* records, long size)');
+
+                const records = [
+                    { values: [1, 2, 3, 4, 5], index: 5 },
+                    { values: [2, 3, 4, 5, 6], index: 6 },
+                    { index: 7 }
+                ];
+                const buffer = TRecWithArray.packArray(records);
+                assert.equal(buffer.length, 3 * TRecWithArray.size);
+                lib.interface.incRecWithArrays(buffer, records.length);
+
+                assert.deepEqual(TRecWithArray.unpackArray(buffer), [
+                    { values: [2, 3, 4, 5, 6], index: 6 },
+                    { values: [3, 4, 5, 6, 7], index: 7 },
+                    { values: [1, 1, 1, 1, 1], index: 8 }
+                ]);
+                assert.deepEqual(TRecWithArray.unpackArray(buffer, 1, TRecWithArray.size), [
+                    { values: [3, 4, 5, 6, 7], index: 7 }
+                ]);
+
+                const chunks = [];
+                for (const chunk of TRecWithArray.packChunks(records, 2)) {
+                    lib.interface.incRecWithArrays(chunk.buffer, chunk.count);
+                    chunks.push(TRecWithArray.unpackArray(chunk.buffer, chunk.count));
+                }
+                assert.deepEqual(_.flatten(chunks), TRecWithArray.unpackArray(buffer));
+            });
+
+            it('should pack strings into char fields like the setters', function () {
+                const TChars = new StructType({ c: 'uchar', d: 'char' });
+                const records = [{ c: '\u00e9', d: 'x' }, { c: 'abc', d: '' }];
+                const buffer = TChars.packArray(records);
+                for (let i = 0; i < records.length; i++) {
+                    const expected = TChars.fromObject(records[i]).ref();
+                    assert.deepEqual(buffer.slice(i * TChars.size, (i + 1) * TChars.size), expected);
+                }
+                assert.deepEqual(TChars.unpackArray(buffer), [{ c: 0xe9, d: 120 }, { c: 97, d: 0 }]);
+            });
+
+            it('should range check packed numbers and keep packed pointers alive', function () {
+                const TPacked = new StructType({ c: 'char', s: 'ushort', i: 'int', p: 'pointer' });
+                for (const record of [{ c: 128 }, { s: -1 }, { s: 0x10000 }, { i: 0x80000000 }, { i: '-2147483649' }]) {
+                    assert.throws(() => TPacked.fromObject(record), RangeError);
+                    assert.throws(() => TPacked.packArray([record]), RangeError);
+                }
+
+                const target = ref.alloc('int', 42);
+                const buffer = TPacked.packArray([{ c: -128, s: 0xffff, i: -1, p: target }]);
+                assert.deepEqual(buffer._refs, [target]);
+                const record = TPacked.unpackArray(buffer)[0];
+                assert.deepEqual([record.c, record.s, record.i], [-128, 0xffff, -1]);
+                assert.equal(ref.address(record.p), ref.address(target));
+            });
+
+            it('should provide columns of native record arrays', function () {
+                const TRecWithArray = new StructType({
+                    values: new ArrayType(ref.types.long, 5),
+                    index: 'uint'
+                });
+                lib
+                .function('void makeRecWithArrays(void** records, long* size)')
+                .function('void freeRecWithArrays(void* records)');
+
+                const recordsRef = ref.alloc('pointer');
+                const sizeRef = ref.alloc('long');
+                lib.interface.makeRecWithArrays(recordsRef, sizeRef);
+                const records = recordsRef.deref();
+                const columns = TRecWithArray.columns(records, sizeRef.deref());
+
+                assert.equal(columns.index.length, 5);
+                assert(columns.index.view instanceof Uint32Array);
+                assert.deepEqual(columns.index.toArray(), [0, 1, 2, 3, 4]);
+                columns.index.set(1, 42);
+                assert.equal(columns.index.get(1), 42);
+                assert.deepEqual(Array.from(columns.index.gather()), [0, 42, 2, 3, 4]);
+                columns.index.scatter(new Uint32Array([4, 3, 2, 1, 0]));
+                assert.deepEqual(columns.index.toArray(), [4, 3, 2, 1, 0]);
+                assert.deepEqual(columns.values.get(3).toArray(), [0, 1, 2, 3, 4]);
+                assert.equal(TRecWithArray.unpackArray(records, 5)[1].index, 3);
+                assert.throws(() => columns.index.set(0, -1), RangeError);
+                assert.throws(() => columns.index.set(0, 0x100000000), RangeError);
+                assert.throws(() => columns.index.set(5, 1), RangeError);
+                assert.throws(() => columns.index.get(-1), RangeError);
+                assert.throws(() => columns.values.get(5), RangeError);
+                assert.deepEqual(columns.index.toArray(), [4, 3, 2, 1, 0]);
+
+                lib.interface.freeRecWithArrays(records);
+            });
+
             describe('with C like syntax', function () {
                 it('should work for a simple declaration (https://github.com/cmake-js/fastcall/issues/15)', function () {
                     const result = lib
@@ -578,6 +578,295 @@ describe('Library', function () {
         });
     });
 
+    describe('adaptive call mode', function () {
+        it('should make short calls inline and offload the long ones', async(function* () {
+            const lib = new Library(libPath, { adaptiveThreshold: 0 });
+            try {
+                lib.adaptiveFunction('int mul(int value, int by)');
+                const mul = lib.interface.mul;
+                const func = lib.functions.mul;
+                assert.equal(func.callMode, Library.callMode.adaptive);
+                assert.deepEqual(func.stats, { latency: 0, samples: 0, syncCalls: 0, asyncCalls: 0 });
+
+                // nothing measured yet, so it's predicted to be short
+                const promise = mul(21, 2);
+                assert.equal(func.stats.syncCalls, 1);
+                assert.equal(func.stats.samples, 1);
+                assert.equal(yield promise, 42);
+
+                // longer than 0 microseconds
+                assert(func.stats.latency > 0);
+                assert.equal(yield mul(2, 3), 6);
+                assert.equal(func.stats.asyncCalls, 1);
+                assert.equal(func.stats.samples, 2);
+
+                assert.equal(mul.sync(3, 3), 9);
+                assert.equal(yield mul.async(4, 3), 12);
+                assert.equal(func.stats.samples, 2);
+            }
+            finally {
+                lib.release();
+            }
+        }));
+    });
+
+    describe('call ring', function () {
+        it('should make the submitted calls and publish their results', async(function* () {
+            if (typeof SharedArrayBuffer !== 'function') {
+                return this.skip();
+            }
+            const lib = new Library(libPath);
+            try {
+                lib.function('int mul(int value, int by)');
+                lib.function('double addNumbers(float floatValue, int intValue)');
+                lib.function('char readChar(char* str, uint pos)');
+                const ring = lib.callRing({ capacity: 16 });
+                const mul = ring.register('mul');
+                const addNumbers = ring.register(lib.interface.addNumbers);
+                const readChar = ring.register(lib.functions.readChar);
+                assert.equal(ring.register('mul'), mul);
+
+                const str = fastcall.makeStringBuffer('hello');
+                const expected = [];
+                for (let i = 0; i < 16; i++) {
+                    switch (i % 3) {
+                        case 0:
+                            assert.equal(ring.push(mul, i, 2), i);
+                            expected.push(i * 2);
+                            break;
+                        case 1:
+                            ring.push(addNumbers, 0.5, i);
+                            expected.push(i + 0.5);
+                            break;
+                        default:
+                            ring.push(readChar, str, i % 5);
+                            expected.push('hello'.charCodeAt(i % 5));
+                    }
+                }
+                // full
+                assert.equal(ring.push(mul, 1, 1), -1);
+                assert.equal(ring.pending, 16);
+                ring.submit();
+
+                const results = [];
+                while (results.length < 16) {
+                    yield ring.wait();
+                    ring.poll((seq, result, status) => {
+                        assert.equal(seq, results.length);
+                        assert.equal(status, 0);
+                        results.push(result);
+                    });
+                }
+                assert.deepEqual(results, expected);
+                assert.equal(ring.pending, 0);
+
+                // the ring is reusable
+                ring.push(mul, 21, 2);
+                ring.submit();
+                yield ring.wait();
+                ring.poll((seq, result) => assert.equal(result, 42));
+
+                // pointer arguments are kept alive by the ring until they're polled
+                ring.push(readChar, new Uint8Array(['x'.charCodeAt(0), 0]), 0);
+                if (global.gc) {
+                    global.gc();
+                }
+                ring.submit();
+                yield ring.wait();
+                ring.poll((seq, result) => assert.equal(result, 'x'.charCodeAt(0)));
+                assert.throws(() => ring.push(readChar, 'x', 0), TypeError);
+
+                assert.throws(() => ring.push(mul, 21), /arguments/);
+                assert.throws(() => ring.push(mul, 21, 2, 3), /arguments/);
+                assert.equal(ring.pending, 0);
+
+                // nothing to wait for
+                const waiting = ring.wait().reflect();
+                ring.release();
+                assert(/released/.test((yield waiting).reason().message));
+            }
+            finally {
+                lib.release();
+            }
+        }));
+    });
+
+    describe('batches', function () {
+        let lib = null;
+        beforeEach(function () {
+            lib = new Library(libPath)
+            .asyncFunction('int mul(int value, int by)')
+            .function('char readChar(char* str, uint pos)');
+        });
+
+        afterEach(function () {
+            lib.release();
+        });
+
+        it('should make the calls of a function', async(function* () {
+            const argsList = _.range(100).map(i => [i, 3]);
+            const results = yield lib.interface.mul.many(argsList);
+            assert(results instanceof Float64Array);
+            assert.deepEqual(Array.from(results), _.range(100).map(i => i * 3));
+
+            const chunked = yield lib.interface.mul.many(argsList.slice(0, 10), { chunkSize: 1 });
+            assert.deepEqual(Array.from(chunked), _.range(10).map(i => i * 3));
+
+            assert.equal((yield lib.interface.mul.many([])).length, 0);
+        }));
+
+        it('should make the calls of different functions', async(function* () {
+            const str = fastcall.makeStringBuffer('batch');
+            const results = yield lib.submitBatch([
+                { fn: 'mul', args: [21, 2] },
+                { fn: lib.interface.readChar, args: [str, 1] },
+                { fn: lib.functions.mul, args: [-2, 4] }
+            ]);
+            assert.deepEqual(Array.from(results), [42, 'a'.charCodeAt(0), -8]);
+        }));
+
+        it('should pass TypedArrays and array buffers as pointers', async(function* () {
+            const bytes = new Uint8Array([0, 'x'.charCodeAt(0), 'y'.charCodeAt(0), 0]);
+            const results = yield lib.submitBatch([
+                { fn: 'readChar', args: [bytes, 1] },
+                { fn: 'readChar', args: [bytes.subarray(1), 1] },
+                { fn: 'readChar', args: [bytes.buffer, 2] },
+                { fn: 'readChar', args: [new DataView(bytes.buffer, 2), 0] }
+            ]);
+            assert.deepEqual(Array.from(results), ['x', 'y', 'y', 'y'].map(c => c.charCodeAt(0)));
+        }));
+
+        it('should reject arguments out of the range of their types', function () {
+            const str = fastcall.makeStringBuffer('batch');
+            assert.throws(() => lib.submitBatch([{ fn: 'readChar', args: ['batch', 0] }]), TypeError);
+            assert.throws(() => lib.submitBatch([{ fn: 'readChar', args: [{}, 0] }]), TypeError);
+            assert.throws(() => lib.interface.mul.many([['21', 2]]), TypeError);
+            assert.throws(() => lib.interface.mul.many([[21, 2], [NaN, 2]]), TypeError);
+            assert.throws(() => lib.interface.mul.many([[0x80000000, 2]]), TypeError);
+            assert.throws(() => lib.submitBatch([{ fn: 'readChar', args: [str, -1] }]), TypeError);
+            assert.throws(() => lib.submitBatch([{ fn: 'readChar', args: [-1, 0] }]), TypeError);
+        });
+    });
+
+    describe('call plans', function () {
+        let lib = null;
+        beforeEach(function () {
+            lib = new Library(libPath)
+            .asyncFunction('int mul(int value, int by)')
+            .asyncFunction('void pushChar(char* str, char charCode)');
+        });
+
+        afterEach(function () {
+            lib.release();
+        });
+
+        it('should pass results to the next steps', async(function* () {
+            const plan = lib.callPlan(p => {
+                const first = p.call('mul', [p.arg(0), p.arg(1)]);
+                const second = p.call(lib.interface.mul, [first, 2]);
+                return [first, second];
+            });
+            assert.deepEqual(yield plan(3, 7), [21, 42]);
+            assert.deepEqual(yield plan(-1, 5), [-5, -10]);
+        }));
+
+        it('should skip the steps after a failed check', async(function* () {
+            const str = new Buffer(10);
+            str.fill(0);
+            const plan = lib.callPlan(p => {
+                const value = p.call('mul', [p.arg(0), 2], { check: { gt: 0 } });
+                p.call('pushChar', [str, 'b'.charCodeAt(0)]);
+                p.call('pushChar', [str, 'a'.charCodeAt(0)], { always: true });
+                return value;
+            });
+            try {
+                yield plan(-1);
+                assert(false);
+            }
+            catch (err) {
+                assert(err instanceof fastcall.CallPlanError);
+                assert.equal(err.step, 0);
+                assert.equal(err.function, 'mul');
+                assert.equal(err.result, -2);
+            }
+            assert.equal(str.toString('ascii', 0, 1), 'a');
+            assert.equal(str[1], 0);
+
+            assert.equal(yield plan(1), 2);
+            assert.equal(str.toString('ascii', 0, 3), 'aba');
+        }));
+
+        it('should skip the cleanup steps of failed steps', async(function* () {
+            const str = new Buffer(10);
+            str.fill(0);
+            const plan = lib.callPlan(p => {
+                const value = p.call('mul', [p.arg(0), 1], { check: { gt: 0 }, into: p.slot(0) });
+                p.call('pushChar', [str, value], { always: true });
+                p.call('pushChar', [str, p.slot(0)], { always: true });
+            });
+            try {
+                yield plan(-'a'.charCodeAt(0));
+                assert(false);
+            }
+            catch (err) {
+                assert(err instanceof fastcall.CallPlanError);
+                assert.equal(err.step, 0);
+            }
+            assert.equal(str[0], 0);
+
+            yield plan('a'.charCodeAt(0));
+            assert.equal(str.toString('ascii', 0, 2), 'aa');
+        }));
+    });
+
+    describe('call programs', function () {
+        let lib = null;
+        beforeEach(function () {
+            lib = new Library(libPath)
+            .function('int mul(int value, int by)')
+            .function('void pushChar(char* str, char charCode)');
+        });
+
+        afterEach(function () {
+            lib.release();
+        });
+
+        it('should run the calls synchronously', function () {
+            const program = lib.callProgram(p => {
+                const first = p.call('mul', [p.arg(0), p.slot(0)], { into: p.slot(1) });
+                return p.call('mul', [first, p.arg(1)], { into: p.slot(0) });
+            });
+            program.scratch[0] = 1;
+            assert.equal(program(2, 3), 6);
+            assert.deepEqual(Array.from(program.scratch), [6, 2]);
+            assert.equal(program(2, 3), 36);
+            assert.deepEqual(Array.from(program.scratch), [36, 12]);
+        });
+
+        it('should throw on failed checks', function () {
+            const str = new Buffer(10);
+            str.fill(0);
+            const program = lib.callProgram(p => {
+                p.call('mul', [p.arg(0), 1], { check: { ne: 0 } });
+                p.call('pushChar', [p.arg(1), 'a'.charCodeAt(0)]);
+            });
+            assert.throws(() => program(0, str), fastcall.CallPlanError);
+            assert.equal(str[0], 0);
+            program(1, str);
+            assert.equal(str.toString('ascii', 0, 1), 'a');
+        });
+
+        it('should reset the slots of failed steps', function () {
+            const program = lib.callProgram(p => {
+                p.call('mul', [p.arg(0), 2], { check: { gt: 0 }, into: p.slot(0) });
+            });
+            assert.equal(program(21), 42);
+            assert.equal(program.scratch[0], 42);
+            assert.throws(() => program(-1), fastcall.CallPlanError);
+            assert.equal(program.scratch[0], 0);
+        });
+    });
+
     describe('types', function () {
         it('supports 64 bit integers', function () {
             const lib = new Library(libPath);
@@ -589,4 +878,361 @@ describe('Library', function () {
             assert.strictEqual(uint64ToShort("42"), 42);
         });
     });
+
+    describe('lazy initialization', function () {
+        let lib = null;
+
+        beforeEach(function () {
+            lib = new Library(libPath, { lazy: true });
+        });
+
+        afterEach(function () {
+            lib.release();
+            lib = null;
+        });
+
+        it('should initialize functions on first call', function () {
+            lib.declare('int mul(int value, int by); int notThere(int value);');
+            assert(!lib.functions.mul.initialized);
+            assert(!lib.functions.notThere.initialized);
+
+            const stub = lib.interface.mul;
+            assert(_.isFunction(stub));
+            assert.strictEqual(stub.function, lib.functions.mul);
+
+            assert.equal(stub(21, 2), 42);
+            assert(lib.functions.mul.initialized);
+            assert.notStrictEqual(lib.interface.mul, stub);
+            assert.equal(lib.interface.mul(21, 2), 42);
+            // Stubs captured before the first call should keep working:
+            assert.equal(stub(2, 2), 4);
+
+            // Missing symbols get reported on first call:
+            assert.throws(() => lib.interface.notThere(1), /notThere/);
+        });
+
+        it('should initialize async functions on first call', async(function* () {
+            lib.declareAsync('int mul(int value, int by)');
+            assert(!lib.functions.mul.initialized);
+            assert.equal(yield lib.interface.mul(21, 2), 42);
+            assert(lib.functions.mul.initialized);
+            assert.equal(lib.interface.mul.sync(21, 2), 42);
+        }));
+    });
+
+    describe('pointer-like arguments', function () {
+        let lib = null;
+
+        afterEach(function () {
+            lib.release();
+            lib = null;
+        });
+
+        it('should accept TypedArrays and array buffers in place of pointers', async(function* () {
+            lib = new Library(libPath);
+            lib.declare('char readChar(void* str, uint pos); void appendChar(char* str, uint pos, char charCode);');
+            const bytes = new Uint8Array([1, 2, 3, 4]);
+            assert.equal(lib.interface.readChar(bytes, 1), 2);
+            // byteOffset is honoured:
+            assert.equal(lib.interface.readChar(bytes.subarray(2), 0), 3);
+            assert.equal(lib.interface.readChar(new DataView(bytes.buffer, 3), 0), 4);
+            assert.equal(lib.interface.readChar(bytes.buffer, 0), 1);
+            lib.interface.appendChar(bytes.subarray(1), 0, 42);
+            assert.equal(bytes[1], 42);
+
+            if (typeof SharedArrayBuffer !== 'undefined') {
+                const shared = new SharedArrayBuffer(4);
+                new Uint8Array(shared)[2] = 42;
+                assert.equal(lib.interface.readChar(shared, 2), 42);
+                assert.equal(yield lib.interface.readChar.async(new Uint8Array(shared), 2), 42);
+            }
+        }));
+    });
+
+    describe('call signatures', function () {
+        let lib = null;
+
+        afterEach(function () {
+            lib.release();
+            lib = null;
+        });
+
+        it('should share call state between functions of the same signature', async(function* () {
+            lib = new Library(libPath);
+            lib.declare(
+                'union TUnion { short a; int64 b; long c; };' +
+                'int64 getAFromUnion(TUnion* u);' +
+                'int64 getBFromUnion(TUnion* u);' +
+                'int mul(int value, int by);');
+            const getA = lib.functions.getAFromUnion;
+            const getB = lib.functions.getBFromUnion;
+            const mul = lib.functions.mul;
+            assert.strictEqual(getA._signature, getB._signature);
+            assert.notStrictEqual(getA._signature, mul._signature);
+            assert(mul._signature.vmSize < 512);
+            assert.equal(lib.interface.getAFromUnion(null), 0);
+            assert.equal(lib.interface.getBFromUnion(null), 0);
+            assert.equal(lib.interface.mul(21, 2), 42);
+
+            assert.equal(yield lib.interface.mul.async(21, 2), 42);
+            const asyncMul = mul._others[Library.callMode.async];
+            assert(asyncMul._signature);
+            assert.notStrictEqual(asyncMul._signature, mul._signature);
+            assert.equal(lib.interface.mul(2, 2), 4);
+        }));
+
+        it('should support callbacks calling functions of the same signature', function () {
+            lib = new Library(libPath);
+            lib.declare(
+                'int (*TMakeIntFunc)(float fv, double dv);' +
+                'int makeInt(float fv, double dv, TMakeIntFunc func);');
+            const makeInt = lib.interface.makeInt;
+            const calls = [];
+            const result = makeInt(1.5, 2, (fv, dv) => {
+                calls.push([fv, dv]);
+                const inner = makeInt(fv, dv * 2, (fv, dv) => {
+                    calls.push([fv, dv]);
+                    return fv + dv;
+                });
+                calls.push([fv, dv]);
+                return inner + 1;
+            });
+            assert.deepEqual(calls, [[1.5, 2], [1.5, 4], [1.5, 2]]);
+            assert.equal(result, ((5 * 2) + 1) * 2);
+            assert.equal(makeInt(1.5, 2, (fv, dv) => fv + dv), 6);
+        });
+    });
+
+    describe('initializeAsync', function () {
+        let lib = null;
+
+        afterEach(function () {
+            lib.release();
+            lib = null;
+        });
+
+        it('should load the library in the background', async(function* () {
+            lib = new Library(libPath);
+            const result = yield lib.initializeAsync();
+            assert.strictEqual(result, lib);
+            lib.declare('int mul(int value, int by)');
+            assert.equal(lib.interface.mul(21, 2), 42);
+        }));
+
+        it('should resolve lazy functions while loading', async(function* () {
+            lib = new Library(libPath, { lazy: true, loadFlags: Library.loadFlags.now | Library.loadFlags.local });
+            lib.declare('int mul(int value, int by)');
+            assert(!lib._initialized);
+            yield lib.initializeAsync({ prelink: true });
+            assert(lib.functions.mul._ptr);
+            assert.equal(lib.interface.mul(21, 2), 42);
+        }));
+
+        it('should fail when the library gets released while loading', async(function* () {
+            lib = new Library(libPath, { lazy: true });
+            lib.declare('int mul(int value, int by)');
+            const loading = lib.initializeAsync({ prelink: true }).reflect();
+            lib.release();
+            const result = yield loading;
+            assert(result.isRejected());
+            assert(/released/.test(result.reason().message));
+            assert(!lib._initialized);
+            assert(!lib.functions.mul._ptr);
+            assert.throws(() => lib.interface.mul(21, 2), /released/);
+        }));
+
+        it('should fail when the library does not exist', async(function* () {
+            lib = new Library('bubukittyfuck');
+            let error = null;
+            try {
+                yield lib.initializeAsync();
+            }
+            catch (err) {
+                error = err;
+            }
+            assert(error instanceof Error);
+            assert(!lib._initialized);
+        }));
+    });
+
+    describe('prelink', function () {
+        let lib = null;
+
+        afterEach(function () {
+            lib.release();
+            lib = null;
+        });
+
+        it('should resolve symbols of lazy functions in one go', function () {
+            lib = new Library(libPath, { lazy: true });
+            lib.declare('int mul(int value, int by); int notThere(int value); int notHereEither();');
+            assert.throws(() => lib.prelink(), /notThere, notHereEither/);
+            assert(lib.functions.mul._ptr);
+            assert(!lib.functions.mul.initialized);
+            assert.equal(lib.interface.mul(21, 2), 42);
+        });
+
+        it('should resolve symbols of lazy functions asynchronously', async(function* () {
+            lib = new Library(libPath, { lazy: true });
+            lib.declare('int mul(int value, int by)');
+            yield lib.prelinkAsync();
+            assert(lib.functions.mul._ptr);
+            assert.equal(lib.interface.mul(21, 2), 42);
+        }));
+
+        it('should report every missing symbol of a declaration', function () {
+            lib = new Library(libPath);
+            assert.throws(() => lib.declare('int mul(int value, int by); int notThere(int value); int notHereEither();'),
+                /notThere, notHereEither/);
+            assert(!lib.functions.mul);
+            assert(!lib.interface.mul);
+            assert(!lib.functions.notThere);
+            assert(!lib.interface.notThere);
+            lib.declare('int mul(int value, int by)');
+            assert.equal(lib.interface.mul(21, 2), 42);
+        });
+
+        it('should add nothing of a declaration having an invalid part', function () {
+            lib = new Library(libPath);
+            assert.throws(() => lib.declare(
+                'struct TPair { int a; int b; };' +
+                'int (*TMakeIntFunc)(float fv, double dv);' +
+                'int mul(int value, int by);' +
+                'this is not a declaration;'));
+            assert(!lib.structs.TPair);
+            assert(!lib.callbacks.TMakeIntFunc);
+            assert(!lib.functions.mul);
+            assert.deepEqual(_.keys(lib.interface), []);
+        });
+
+        it('should fail asynchronous prelinking of released libraries', async(function* () {
+            lib = new Library(libPath, { lazy: true });
+            lib.declare('int mul(int value, int by)');
+            const prelinking = lib.prelinkAsync().reflect();
+            lib.release();
+            const result = yield prelinking;
+            assert(result.isRejected());
+            assert(/released/.test(result.reason().message));
+            assert(!lib.functions.mul._ptr);
+        }));
+    });
+
+    describe('argument qualifiers', function () {
+        let lib = null;
+
+        afterEach(function () {
+            lib.release();
+            lib = null;
+        });
+
+        it('should return borrowed native memory as TypedArrays', async(function* () {
+            lib = new Library(libPath);
+            lib.function('void getNumbers(out length(size) double** nums, out size_t* size)');
+            assert.equal(lib.functions.getNumbers.toString(), 'void getNumbers(out length(size) double** nums, out size_t* size)');
+
+            const output = lib.interface.getNumbers();
+            assert(!_.has(output, 'result'));
+            assert.equal(output.size, 3);
+            assert(output.nums instanceof Float64Array);
+            assert.deepEqual(Array.from(output.nums), [1.1, 2.2, 3.3]);
+
+            const asyncOutput = yield lib.interface.getNumbers.async();
+            assert.deepEqual(Array.from(asyncOutput.nums), [1.1, 2.2, 3.3]);
+        }));
+
+        it('should release owned native memory by scopes', function () {
+            lib = new Library(libPath);
+            const TRecWithArray = new fastcall.StructType({
+                values: new fastcall.ArrayType(ref.types.long, 5),
+                index: 'uint'
+            });
+            lib.struct({ TRecWithArray });
+            lib.function('void makeRecWithArrays(out owned(freeRecWithArrays) length(size) TRecWithArray** records, out long* size)');
+
+            const count = fastcall.Disposable.stats().count;
+            fastcall.scope(() => {
+                const output = lib.interface.makeRecWithArrays();
+                assert.equal(output.size, 5);
+                assert(_.isBuffer(output.records));
+                assert.equal(output.records.length, 5 * TRecWithArray.size);
+                assert.deepEqual(TRecWithArray.unpackArray(output.records).map(rec => rec.index), [0, 1, 2, 3, 4]);
+                assert(output.records.disposable instanceof fastcall.Disposable);
+                assert.equal(fastcall.Disposable.stats().count, count + 1);
+            });
+            assert.equal(fastcall.Disposable.stats().count, count);
+        });
+
+        it('should allocate output buffers from the arena of the scope', function () {
+            lib = new Library(libPath);
+            lib.function('void appendChar(arena length(4) char* str, uint pos, char charCode)');
+
+            fastcall.scope(() => {
+                const output = lib.interface.appendChar(2, 42);
+                assert(output.str instanceof Int8Array);
+                assert.deepEqual(Array.from(output.str), [0, 0, 42, 0]);
+            });
+            assert.throws(() => lib.interface.appendChar(0, 1), /no active scope/);
+        });
+
+        it('should return output arrays from reused scratch buffers', async(function* () {
+            lib = new Library(libPath);
+            lib.function('void appendChar(out length(4) char* str, uint pos, char charCode)');
+            const appendChar = lib.interface.appendChar;
+
+            const first = appendChar(2, 42);
+            const second = appendChar(1, 43);
+            assert(first.str instanceof Int8Array);
+            assert.deepEqual(Array.from(first.str), [0, 0, 42, 0]);
+            assert.deepEqual(Array.from(second.str), [0, 43, 0, 0]);
+            // copied out of the scratch, that the next call reuses
+            assert.notStrictEqual(first.str.buffer, second.str.buffer);
+
+            const outputs = yield Promise.all([appendChar.async(0, 1), appendChar.async(3, 2)]);
+            assert.deepEqual(Array.from(outputs[0].str), [1, 0, 0, 0]);
+            assert.deepEqual(Array.from(outputs[1].str), [0, 0, 0, 2]);
+
+            lib.function('void getNumbers(out length(size) double** nums, out size_t* size)');
+            const results = _.range(3).map(() => lib.interface.getNumbers());
+            for (const result of results) {
+                assert.equal(result.size, 3);
+                assert.deepEqual(Array.from(result.nums), [1.1, 2.2, 3.3]);
+            }
+        }));
+
+        it('should pass interned strings from the cache of the library', async(function* () {
+            lib = new Library(libPath, { stringCacheSize: 2 });
+            lib.function('char readChar(interned string str, uint pos)');
+            assert.equal(lib.functions.readChar.toString(), 'char readChar(interned string str, uint pos)');
+            const readChar = lib.interface.readChar;
+            const cache = lib.stringCache;
+            // generated with fixed arity, like the wrappers of the other functions
+            assert.equal(readChar.length, 2);
+
+            assert.equal(readChar('abc', 1), 'b'.charCodeAt(0));
+            assert.equal(readChar('abc', 2), 'c'.charCodeAt(0));
+            assert.equal(yield readChar.async('abc', 0), 'a'.charCodeAt(0));
+            assert.equal(cache.size, 1);
+            assert.equal(cache.misses, 1);
+            assert.equal(cache.hits, 2);
+
+            const buffer = cache.get('abc');
+            assert.equal(readChar('de', 0), 'd'.charCodeAt(0));
+            assert.equal(readChar('fg', 0), 'f'.charCodeAt(0));
+            assert.equal(cache.size, 2);
+            assert.notStrictEqual(cache.get('abc'), buffer);
+            assert.equal(readChar(fastcall.makeStringBuffer('xy'), 1), 'y'.charCodeAt(0));
+            assert.equal(cache.size, 2);
+
+            lib.release();
+            assert.equal(cache.size, 0);
+        }));
+
+        it('should validate the qualifiers', function () {
+            lib = new Library(libPath);
+            assert.throws(() => lib.function('int mul(out int value, int by)'), /not a pointer/);
+            assert.throws(() => lib.function('void getNumbers(length(size) double** nums, size_t* size)'), /not an out argument/);
+            assert.throws(() => lib.function('void getNumbers(out length(count) double** nums, out size_t* size)'), /unknown argument "count"/);
+            assert.throws(() => lib.function('int mul(interned int value, int by)'), /not a string/);
+        });
+    });
 });
\ No newline at end of file
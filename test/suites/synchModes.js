@@ -32,29 +32,13 @@ describe(`Synchronization Modes`, function () {
     }));
 
     describe('lock', function () {
-        let lockCounter = null;
+        const unlocked = { readers: 0, writer: false, waiting: 0 };
 
         beforeEach(function () {
             lib = new Library(libPath, { syncMode: Library.syncMode.lock });
             assert.equal(lib.options.syncMode, Library.syncMode.lock);
             assert(lib.synchronized);
             assert(!lib.queued);
-            lockCounter = null;
-            const oldLock = lib._lock;
-            assert(_.isFunction(oldLock));
-            const oldUnlock = lib._unlock;
-            assert(_.isFunction(oldUnlock));
-            lib._lock = () => {
-                lockCounter = (lockCounter || 0) + 1;
-                assert(lib._mutex instanceof Buffer);
-                return oldLock.call(lib);
-            };
-            lib._unlock = () => {
-                --lockCounter;
-                assert(lockCounter >= 0);
-                assert(lib._mutex instanceof Buffer);
-                return oldUnlock.call(lib);
-            };
         });
 
         afterEach(function () {
@@ -62,18 +46,86 @@ describe(`Synchronization Modes`, function () {
         });
 
         describe('sync', function () {
-            it('should create and use a mutex', function () {
+            it('should take the lock in the native call', function () {
                 lib.syncFunction('int mul(int value, int by)');
                 assert.equal(lib.interface.mul(21, 2), 42);
-                assert.strictEqual(lockCounter, 0);
+                assert(lib._locks[''] instanceof Buffer);
+                assert.deepEqual(lib.lockState(), unlocked);
+            });
+
+            it('should release the lock when callbacks call other functions', function () {
+                lib.callback('int TMakeIntFunc(float fv, double dv)');
+                lib.syncFunction('int makeInt(float fv, double dv, TMakeIntFunc func)');
+                lib.syncFunction('lockgroup(math) int mul(int value, int by)');
+                const result = lib.interface.makeInt(19.9, 2, (fv, dv) => lib.interface.mul(Math.floor(fv + dv), 1));
+                assert.equal(result, 42);
+                assert.deepEqual(lib.lockState(), unlocked);
+                assert.deepEqual(lib.lockState('math'), unlocked);
             });
         });
 
         describe('async', function () {
-            it('should create and use a mutex', async(function* () {
+            it('should take the lock on the worker thread', async(function* () {
+                lib.asyncFunction('int mul(int value, int by)');
+                const promises = [];
+                for (let i = 0; i < 20; i++) {
+                    promises.push(lib.interface.mul(21, 2));
+                }
+                assert.deepEqual(yield Promise.all(promises), _.fill(Array(20), 42));
+                assert.deepEqual(lib.lockState(), unlocked);
+            }));
+
+            it('should park the calls waiting for the lock', async(function* () {
                 lib.asyncFunction('int mul(int value, int by)');
-                assert.equal(yield lib.interface.mul(21, 2), 42);
-                assert.strictEqual(lockCounter, 0);
+                const mul = lib.interface.mul;
+                const signal = new Signal();
+                const promises = [];
+                for (let i = 0; i < 20; i++) {
+                    promises.push(mul.with({ signal })(21, 2).reflect());
+                }
+                // the parked calls are not running, they can be dropped
+                signal.abort();
+                const results = yield Promise.all(promises);
+                for (const result of results) {
+                    assert(result.isFulfilled() ? result.value() === 42 : result.reason() instanceof fastcall.CancelledError);
+                }
+                assert.deepEqual(lib.lockState(), unlocked);
+                assert.equal(yield mul(21, 2), 42);
+            }));
+
+            it('should keep the lock alive for the calls in progress on release', async(function* () {
+                lib.asyncFunction('int mul(int value, int by)');
+                const promises = [];
+                for (let i = 0; i < 20; i++) {
+                    promises.push(lib.interface.mul(21, 2).reflect());
+                }
+                lib.release();
+                if (global.gc) {
+                    global.gc();
+                }
+                const results = yield Promise.all(promises);
+                for (const result of results) {
+                    assert(result.isFulfilled() ? result.value() === 42 : /released/.test(result.reason().message));
+                }
+            }));
+
+            it('should support shared mode and lock groups', async(function* () {
+                lib.asyncFunction('shared lockgroup(math) int mul(int value, int by)');
+                lib.asyncFunction({ readChar: ['char', ['string', 'uint'], { shared: true }] });
+                assert.equal(lib.functions.mul.toString(), 'shared lockgroup(math) int mul(int value, int by)');
+                assert.deepEqual(lib.functions.readChar.lock, { shared: true, group: null });
+
+                const promises = [];
+                for (let i = 0; i < 20; i++) {
+                    promises.push(lib.interface.mul(i, 2));
+                    promises.push(lib.interface.readChar('abc', 1));
+                }
+                const results = yield Promise.all(promises);
+                assert.equal(results[38], 38);
+                assert.equal(results[39], 'b'.charCodeAt(0));
+                assert.equal(lib.interface.mul.sync(21, 2), 42);
+                assert.deepEqual(lib.lockState('math'), unlocked);
+                assert(lib._locks.math instanceof Buffer);
             }));
         });
     });
@@ -117,6 +169,50 @@ describe(`Synchronization Modes`, function () {
                     yield Promise.all(promises);
                 }
             }));
+
+            it('should call functions on the thread of the library', async(function* () {
+                lib.syncFunction('uint64 getThreadId()');
+                lib.callback('int TMakeIntFunc(float fv, double dv)');
+                lib.syncFunction('int makeInt(float fv, double dv, TMakeIntFunc func)');
+                const other = new Library(libPath).initialize();
+                try {
+                    other.syncFunction('uint64 getThreadId()');
+                    const mainThreadId = other.interface.getThreadId();
+                    const threadId = lib.interface.getThreadId();
+                    assert.notEqual(threadId, mainThreadId);
+                    assert.equal(lib.interface.getThreadId(), threadId);
+                    assert.equal(yield lib.interface.getThreadId.async(), threadId);
+
+                    // callbacks of forwarded calls run on the main thread
+                    const result = lib.interface.makeInt(19.9, 2, (fv, dv) => {
+                        assert.equal(other.interface.getThreadId(), mainThreadId);
+                        return fv + dv;
+                    });
+                    assert.equal(result, 42);
+                }
+                finally {
+                    other.release();
+                }
+            }));
+
+            it('should fail when callbacks call the library synchronously', function () {
+                lib.syncFunction('int mul(int value, int by)');
+                lib.callback('int TMakeIntFunc(float fv, double dv)');
+                lib.syncFunction('int makeInt(float fv, double dv, TMakeIntFunc func)');
+                let error = null;
+                const result = lib.interface.makeInt(19.9, 2, (fv, dv) => {
+                    try {
+                        return lib.interface.mul(fv + dv, 1);
+                    }
+                    catch (err) {
+                        error = err;
+                        return fv + dv;
+                    }
+                });
+                assert.equal(result, 42);
+                assert(error);
+                assert(/callbacks/.test(error.message));
+            });
         });
 
         describe('async', function () {
@@ -135,10 +231,306 @@ describe(`Synchronization Modes`, function () {
                 const str = ref.readCString(strBuff, 0);
                 assert.equal(str, reference);
             }));
+
+            it('should drop cancelled calls before their execution', async(function* () {
+                lib.asyncFunction('int mul(int value, int by)');
+                const mul = lib.interface.mul;
+
+                const aborted = new Signal();
+                aborted.abort();
+                try {
+                    yield mul.with({ signal: aborted })(21, 2);
+                    assert(false, 'unreachable');
+                }
+                catch (err) {
+                    assert(err instanceof fastcall.CancelledError);
+                    assert.equal(err.code, 'ECANCELED');
+                    assert.equal(err.reason, 'aborted');
+                }
+                try {
+                    yield mul.with({ timeout: 0 })(21, 2);
+                    assert(false, 'unreachable');
+                }
+                catch (err) {
+                    assert(err instanceof fastcall.CancelledError);
+                    assert.equal(err.reason, 'timeout');
+                }
+                assert.equal(yield mul.with({ timeout: 10000 })(21, 2), 42);
+
+                const signal = new Signal();
+                const promises = [];
+                for (let i = 0; i < 100; i++) {
+                    promises.push(mul.with({ signal })(21, 2).reflect());
+                }
+                signal.abort();
+                const results = yield Promise.all(promises);
+                const cancelled = results.filter(result => result.isRejected());
+                const completed = results.filter(result => result.isFulfilled());
+                for (const result of cancelled) {
+                    assert(result.reason() instanceof fastcall.CancelledError);
+                }
+                for (const result of completed) {
+                    assert.equal(result.value(), 42);
+                }
+                assert.equal(cancelled.length + completed.length, 100);
+                assert.equal(lib.cancellations.aborted, cancelled.length + 1);
+                assert.equal(lib.cancellations.timedOut, 1);
+                assert(lib._isIdle());
+            }));
+
+            it('should fail the pending calls on release', async(function* () {
+                lib.asyncFunction('int mul(int value, int by)');
+                lib.callback('int TMakeIntFunc(float fv, double dv)');
+                lib.asyncFunction('int makeInt(float fv, double dv, TMakeIntFunc func)');
+                const promises = [lib.interface.makeInt(19.9, 2, (fv, dv) => fv + dv).reflect()];
+                for (let i = 0; i < 100; i++) {
+                    promises.push(lib.interface.mul(21, 2).reflect());
+                }
+                lib.release();
+                const results = yield Promise.all(promises);
+                for (const result of results) {
+                    if (result.isFulfilled()) {
+                        assert.equal(result.value(), 42);
+                    }
+                    else {
+                        assert(/released/.test(result.reason().message));
+                    }
+                }
+            }));
+
+            it('should not serialize calls of different libraries', async(function* () {
+                const other = new Library(libPath, { syncMode: Library.syncMode.queue });
+                try {
+                    lib.asyncFunction('uint64 getThreadId()');
+                    other.asyncFunction('uint64 getThreadId()');
+                    const ids = yield Promise.all([
+                        lib.interface.getThreadId(),
+                        other.interface.getThreadId(),
+                        lib.interface.getThreadId()]);
+                    assert.notEqual(ids[0], ids[1]);
+                    assert.equal(ids[0], ids[2]);
+                }
+                finally {
+                    other.release();
+                }
+            }));
         });
     });
+
+    describe('thread pool', function () {
+        // async calls of makeInt keep their worker threads busy
+        // until their callbacks get run by the event loop
+        const poolSize = Number(process.env.UV_THREADPOOL_SIZE) || 4;
+
+        beforeEach(function () {
+            lib = new Library(libPath);
+            lib.callback('int TMakeIntFunc(float fv, double dv)');
+            lib.asyncFunction('int makeInt(float fv, double dv, TMakeIntFunc func)');
+            lib.asyncFunction('int mul(int value, int by)');
+        });
+
+        afterEach(function () {
+            lib.release();
+        });
+
+        it('should cancel calls waiting for a worker thread', async(function* () {
+            const busy = _.range(poolSize).map(() => lib.interface.makeInt(1.5, 2, (fv, dv) => fv + dv));
+            const signal = new Signal();
+            const promises = _.range(10).map(i => lib.interface.mul.with({ signal })(i, 2).reflect());
+            signal.abort();
+            assert.deepEqual(yield Promise.all(busy), _.range(poolSize).map(() => 6));
+            for (const result of yield Promise.all(promises)) {
+                assert(result.reason() instanceof fastcall.CancelledError);
+                assert.equal(result.reason().reason, 'aborted');
+            }
+            assert.deepEqual(lib.cancellations, { aborted: 10, timedOut: 0, tooLate: 0 });
+            assert.equal(yield lib.interface.mul(21, 2), 42);
+        }));
+
+        it('should complete calls cancelled after they have started', async(function* () {
+            const signal = new Signal();
+            const result = yield lib.interface.makeInt.with({ signal })(1.5, 2, (fv, dv) => {
+                // the native call is in progress on a worker thread
+                signal.abort();
+                return fv + dv;
+            });
+            assert.equal(result, 6);
+            assert.deepEqual(lib.cancellations, { aborted: 0, timedOut: 0, tooLate: 1 });
+        }));
+    });
+
+    describe('concurrency limits', function () {
+        afterEach(function () {
+            lib.release();
+        });
+
+        it('should run the waiting calls by their priority', async(function* () {
+            lib = new Library(libPath, { maxConcurrency: 1 });
+            lib.asyncFunction('void pushChar(char* str, char charCode)');
+            const pushChar = lib.interface.pushChar;
+            const strBuff = alloc(21);
+            const promises = [];
+            const push = (c, priority) => {
+                promises.push(pushChar.with({ priority })(strBuff, c.charCodeAt(0)));
+            };
+            push('a', 'default');
+            push('b', 'background');
+            push('c', 'default');
+            push('d', Library.priority.interactive);
+            push('e', 'background');
+            push('f', 'interactive');
+            assert.deepEqual(lib.gateState(), { running: 1, queued: 5 });
+            yield Promise.all(promises);
+            assert.equal(ref.readCString(strBuff, 0), 'adfcbe');
+            assert.deepEqual(lib.gateState(), { running: 0, queued: 0 });
+        }));
+
+        it('should limit the calls of a function', async(function* () {
+            lib = new Library(libPath);
+            lib.asyncFunction('concurrency(1) void pushChar(char* str, char charCode)');
+            assert.equal(lib.functions.pushChar.maxConcurrency, 1);
+            assert.equal(lib.functions.pushChar.toString(), 'concurrency(1) void pushChar(char* str, char charCode)');
+            const strBuff = alloc(21);
+            const promises = [];
+            let reference = '';
+            for (let i = 0; i < 20; i++) {
+                const c = 'a'.charCodeAt(0) + i;
+                promises.push(lib.interface.pushChar(strBuff, c));
+                reference += String.fromCharCode(c);
+            }
+            assert.deepEqual(lib.gateState('pushChar'), { running: 1, queued: 19 });
+            yield Promise.all(promises);
+            assert.equal(ref.readCString(strBuff, 0), reference);
+        }));
+
+        it('should fail the waiting calls on release', async(function* () {
+            lib = new Library(libPath, { syncMode: Library.syncMode.queue, maxConcurrency: 2 });
+            lib.asyncFunction('concurrency(1) int mul(int value, int by)');
+            lib.asyncFunction('void pushChar(char* str, char charCode)');
+            const strBuff = alloc(21);
+            const promises = [];
+            for (let i = 0; i < 10; i++) {
+                promises.push(lib.interface.mul(21, 2).reflect());
+                promises.push(lib.interface.pushChar(strBuff, 'a'.charCodeAt(0)).reflect());
+            }
+            assert.deepEqual(lib.gateState(), { running: 2, queued: 9 });
+            assert.deepEqual(lib.gateState('mul'), { running: 1, queued: 9 });
+            lib.release();
+            if (global.gc) {
+                // the library's gate outlives the function's gate, whatever is collected first
+                global.gc();
+            }
+            const results = yield Promise.all(promises);
+            const failed = results.filter(result => result.isRejected());
+            assert(failed.length >= 18);
+            for (const result of failed) {
+                assert(/released/.test(result.reason().message));
+            }
+        }));
+
+        it('should apply function limits and maxPending to batches', async(function* () {
+            lib = new Library(libPath, { maxPending: 4, backpressure: 'wait' });
+            lib.asyncFunction('concurrency(1) int mul(int value, int by)');
+            const mul = lib.interface.mul;
+            const batch = mul.many(_.range(6).map(i => [i, 2]), { chunkSize: 2 });
+            assert.deepEqual(lib.gateState('mul'), { running: 1, queued: 2 });
+            assert.deepEqual(lib.backpressure, { pending: 6, waiting: 0, rejected: 0 });
+            const next = mul(21, 2);
+            assert.deepEqual(lib.backpressure, { pending: 6, waiting: 1, rejected: 0 });
+            assert.deepEqual(Array.from(yield batch), _.range(6).map(i => i * 2));
+            assert.equal(yield next, 42);
+            assert.deepEqual(lib.backpressure, { pending: 0, waiting: 0, rejected: 0 });
+        }));
+
+        it('should reject calls over maxPending', async(function* () {
+            lib = new Library(libPath, { maxPending: 2 });
+            lib.asyncFunction('int mul(int value, int by)');
+            const promises = [lib.interface.mul(21, 2), lib.interface.mul(21, 2)];
+            try {
+                yield lib.interface.mul(21, 2);
+                assert(false, 'unreachable');
+            }
+            catch (err) {
+                assert(err instanceof fastcall.QueueFullError);
+                assert.equal(err.code, 'EQUEUEFULL');
+            }
+            assert.deepEqual(yield Promise.all(promises), [42, 42]);
+            assert.deepEqual(lib.backpressure, { pending: 0, waiting: 0, rejected: 1 });
+        }));
+
+        it('should make calls over maxPending wait for capacity', async(function* () {
+            lib = new Library(libPath, { maxPending: 2, backpressure: 'wait' });
+            lib.asyncFunction('int mul(int value, int by)');
+            const promises = _.range(10).map(i => lib.interface.mul(i, 2));
+            assert.deepEqual(lib.backpressure, { pending: 2, waiting: 8, rejected: 0 });
+            assert.deepEqual(yield Promise.all(promises), _.range(10).map(i => i * 2));
+            assert.deepEqual(lib.backpressure, { pending: 0, waiting: 0, rejected: 0 });
+        }));
+
+        it('should fail the calls waiting for capacity on release', async(function* () {
+            lib = new Library(libPath, { syncMode: Library.syncMode.queue, maxPending: 2, backpressure: 'wait' });
+            lib.asyncFunction('int mul(int value, int by)');
+            const promises = _.range(10).map(i => lib.interface.mul(i, 2).reflect());
+            assert.deepEqual(lib.backpressure, { pending: 2, waiting: 8, rejected: 0 });
+            lib.release();
+            assert.equal(lib.backpressure.waiting, 0);
+            const results = yield Promise.all(promises);
+            for (const result of results.slice(2)) {
+                assert(result.isRejected());
+                assert(/released/.test(result.reason().message));
+            }
+            try {
+                yield lib.interface.mul(21, 2);
+                assert(false, 'unreachable');
+            }
+            catch (err) {
+                assert(/released/.test(err.message));
+            }
+        }));
+
+        it('should cancel calls waiting for capacity', async(function* () {
+            lib = new Library(libPath, { maxPending: 1, backpressure: 'wait' });
+            lib.asyncFunction('int mul(int value, int by)');
+            const mul = lib.interface.mul;
+            const signal = new Signal();
+            const first = mul(21, 2);
+            const aborted = mul.with({ signal })(1, 2).reflect();
+            const last = mul(3, 2);
+            assert.deepEqual(lib.backpressure, { pending: 1, waiting: 2, rejected: 0 });
+            signal.abort();
+            assert.deepEqual(lib.backpressure, { pending: 1, waiting: 1, rejected: 0 });
+            const result = yield aborted;
+            assert(result.reason() instanceof fastcall.CancelledError);
+            assert.equal(result.reason().reason, 'aborted');
+            assert.deepEqual(yield Promise.all([first, last]), [42, 6]);
+            assert.deepEqual(lib.cancellations, { aborted: 1, timedOut: 0, tooLate: 0 });
+        }));
+    });
 });
 
+// The relevant part of the DOM's AbortController and AbortSignal.
+class Signal {
+    constructor() {
+        this.aborted = false;
+        this._listeners = [];
+    }
+
+    addEventListener(type, listener) {
+        this._listeners.push(listener);
+    }
+
+    removeEventListener(type, listener) {
+        _.pull(this._listeners, listener);
+    }
+
+    abort() {
+        this.aborted = true;
+        for (const listener of this._listeners.slice()) {
+            listener();
+        }
+    }
+}
+
 function alloc(size) {
     if (Buffer.alloc) {
         Buffer.alloc(size);
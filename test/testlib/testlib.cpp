@@ -15,6 +15,7 @@ limitations under the License.
 */
 
 #include "deps.h"
+#include <thread>
 
 using namespace std;
 
@@ -177,6 +178,13 @@ NODE_MODULE_EXPORT void appendChar(char* str, unsigned pos, char charCode)
     str[pos] = charCode;
 }
 
+NODE_MODULE_EXPORT void pushChar(char* str, char charCode)
+{
+    auto length = strlen(str);
+    str[length] = charCode;
+    str[length + 1] = 0;
+}
+
 NODE_MODULE_EXPORT bool isArrayNull(int* arr)
 {
     return arr == nullptr;
@@ -209,4 +217,9 @@ NODE_MODULE_EXPORT void concatStrings(char* strings[], unsigned length, char* ou
     memcpy(output, out.c_str(), out.length());
 }
 
+NODE_MODULE_EXPORT uint64_t getThreadId()
+{
+    return hash<thread::id>()(this_thread::get_id());
+}
+
 }